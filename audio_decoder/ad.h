@@ -39,6 +39,10 @@ struct adinfo {
 /* global init function - register codecs */
 void ad_init();
 
+/* global cleanup - release decoder state that is kept for the next file.
+ * call after the last file was closed */
+void ad_exit();
+
 /* --- public API --- */
 
 /** open an audio file
@@ -48,6 +52,25 @@ void ad_init();
  */
 void *  ad_open  (const char *fn, struct adinfo *nfo);
 
+/** open audio data held in memory
+ * @param buf encoded audio file data. It is not copied and must remain valid until \ref ad_close.
+ * @param len size of buf in bytes
+ * @param nfo pointer to a adinfo struct which will hold information about the file.
+ * @return NULL on error, a pointer to an opaque soundfile-decoder object on success.
+ */
+void *  ad_open_mem (const void *buf, size_t len, struct adinfo *nfo);
+
+/** open audio data from a file-descriptor
+ *
+ * For regular files, data is read from the start of the file regardless of
+ * the current file-offset. Pipes are read sequentially and can not be seeked.
+ *
+ * @param fd file-descriptor open for reading. It is duplicated, the caller retains ownership.
+ * @param nfo pointer to a adinfo struct which will hold information about the file.
+ * @return NULL on error, a pointer to an opaque soundfile-decoder object on success.
+ */
+void *  ad_open_fd  (int fd, struct adinfo *nfo);
+
 /** close an audio file and release decoder structures
  * @param sf decoder handle
  * @return 0 on succees, -1 if sf was invalid or not open (return value can usually be ignored)
@@ -70,6 +93,89 @@ int64_t ad_seek  (void *sf, int64_t pos);
  */
 ssize_t ad_read  (void *sf, float* out, size_t len);
 
+/** pick up data that was appended to the file after it was opened.
+ *
+ * The file is re-examined (header and length) and end-of-file conditions are
+ * cleared, so that subsequent calls to \ref ad_read continue at the current
+ * position with the newly written data. This is intended for files that are
+ * still being recorded to.
+ *
+ * @param sf decoder handle
+ * @param nfo pointer to a adinfo struct which will be updated (may be NULL).
+ * @return 0 on succees, -1 on error or if the backend does not support it
+ */
+int     ad_refresh (void *sf, struct adinfo *nfo);
+
+/** decode all audio streams of the file.
+ *
+ * By default only the first audio stream is decoded. After calling this
+ * function, \ref ad_read_stream returns data of all audio streams, from a
+ * single pass over the file. Files with only one stream (or backends that
+ * do not support multiple streams) report a single stream.
+ * Seeking is not supported in this mode and \ref ad_read must not be used.
+ *
+ * @param sf decoder handle
+ * @param nfo array of at least max adinfo structs, filled with per stream information (may be NULL).
+ * @param index array of at least max ints, set to the container's stream-index (may be NULL).
+ * @param max size of the arrays
+ * @return number of audio streams (which may exceed max), -1 on error
+ */
+int     ad_streams (void *sf, struct adinfo *nfo, int *index, int max);
+
+/** decode a chunk of audio data of any stream, see \ref ad_streams
+ *
+ * @param sf decoder handle
+ * @param out place to store interleaved data -- must be large enough to hold  (sizeof(float) * len) bytes.
+ * @param len number of samples (!) to read, at least the channel-count of the stream with the most channels.
+ * @param stream set to the stream the data belongs to (0 .. \ref ad_streams - 1)
+ * @return the number of read samples, 0 at end of file, -1 on error.
+ */
+ssize_t ad_read_stream (void *sf, float* out, size_t len, int *stream);
+
+/** write a range of the audio to a new file, without decoding.
+ *
+ * PCM data is copied as-is (WAV), other lossless formats are transcoded
+ * to the same format. Compressed audio is remuxed: the copy starts with
+ * the packet that contains the start-frame and ends with the packet that
+ * contains the end-frame, so it may be slightly longer than requested;
+ * the container format of the remuxed file is deduced from the file-name.
+ * The read position of the decoder is not changed.
+ *
+ * @param sf decoder handle
+ * @param fn file to write to, replaced if it exists
+ * @param start first frame to include
+ * @param end frame after the last one to include
+ * @return 0 on success, -1 on error or if the backend does not support it
+ */
+int     ad_copy (void *sf, const char *fn, int64_t start, int64_t end);
+
+/** write several ranges of the audio to new files, see \ref ad_copy
+ *
+ * All ranges are copied in a single pass over the input.
+ * Ranges must be in ascending order and must not overlap.
+ *
+ * @param sf decoder handle
+ * @param fn array of n file-names
+ * @param start array of n start-frames
+ * @param end array of n end-frames
+ * @param n number of ranges
+ * @return 0 on success, -1 on error
+ */
+int     ad_copy_ranges (void *sf, const char * const *fn, int64_t const *start, int64_t const *end, int n);
+
+/** look up the position of a frame in the file.
+ *
+ * For PCM data this is exact for any frame. For compressed audio it is
+ * the position of the packet that contains the frame; this is only
+ * known for packets that were recently decoded, so query it right after
+ * \ref ad_read returned the frame.
+ *
+ * @param sf decoder handle
+ * @param frame frame to look up
+ * @return byte-offset in the file, -1 if unknown
+ */
+int64_t ad_byte_offset (void *sf, int64_t frame);
+
 /** re-read the file information and meta-data.
  *
  * this is not neccesary in general \ref ad_open includes an inplicit call
@@ -21,10 +21,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <unistd.h>
+#include <errno.h>
 #include <math.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "audio_decoder/ad_plugin.h"
+#include "audio_decoder/ad_simd.h"
+#include "audio_decoder/ad_pool.h"
 
 #ifdef HAVE_FFMPEG
 
@@ -34,25 +41,78 @@
 #define MIN(a,b) ( ( (a) < (b) )? (a) : (b) )
 #endif
 
+/* buffer-size of custom I/O contexts */
+#define AVIO_BUFSIZE (65536)
+
+/* number of recently read packets whose file position is known,
+ * ~45 sec for typical packet durations. Lookups of older samples
+ * return -1, silan then estimates the position from the bit-rate. */
+#define POSMAP_SIZE (2048)
+
+/* file position of audio packets, see ad_byte_offset_ffmpeg() */
+typedef struct {
+  int64_t          frame; // stream-time of the packet [frames]
+  int64_t          pos;   // byte-offset of the packet in the file
+  int32_t          n;     // duration [frames], 0: not yet known
+  int32_t          size;  // packet size in bytes
+} ffmpeg_posmap;
+
+/* decoder parameters, a cached codec context is re-used if these match */
+typedef struct {
+  enum AVCodecID   codec_id;
+  int              sample_rate;
+  int              channels;
+  uint64_t         channel_layout;
+  int              block_align;
+  int              bits_per_coded_sample;
+} ffmpeg_codec_key;
+
+/* an additional audio stream, decoded in multi-stream mode */
+typedef struct {
+  int              index; // container stream index
+  AVCodecContext*  codecContext;
+  int16_t*         buf;
+  size_t           bufSize; // bytes
+  int16_t*         bufStart;
+  unsigned long    bufLen;
+} ffmpeg_substream;
+
 typedef struct {
   AVFormatContext* formatContext;
+  AVIOContext*     avio; // custom I/O, if any
+  ad_io*           io;
+  char*            fn;   // file-name or URL, NULL for streams
   AVCodecContext*  codecContext;
+  ffmpeg_codec_key codecKey;
   AVCodec*         codec;
   AVPacket         packet;
   int              audioStream;
   int              pkt_len;
   uint8_t*         pkt_ptr;
 
-  int16_t          m_tmpBuffer[AVCODEC_MAX_AUDIO_FRAME_SIZE];
+  int16_t*         m_tmpBuffer;     // decoded data, sized on demand
+  size_t           m_tmpBufferSize; // bytes
   int16_t*         m_tmpBufferStart;
   unsigned long    m_tmpBufferLen;
 
-  int64_t          decoder_clock;
+  int64_t          decoder_clock; // position of the next decoded sample, -1: not yet known
   int64_t          output_clock;
-  int64_t          seek_frame;
+  int64_t          seek_frame;    // target of a pending seek, -1: none
+  int              seek_retry;    // seeks that ended up past the target
+  int              seek_error;    // the position is unknown, reading fails until the next seek
+  int64_t          pkt_pts;       // timestamp of the current packet, see ad_read_ffmpeg()
+  int64_t          pts_base;      // stream-time of the first sample [frames], incl. encoder delay
+  int              pts_state;     // 0: unknown, 1: first packet only, 2: calibrated
   unsigned int     samplerate;
   unsigned int     channels;
   int64_t          length;
+  int              pcm_direct; // no decoding needed, see pcm_passthrough()
+
+  ffmpeg_substream* sub; // all audio streams, see ad_streams_ffmpeg()
+  unsigned int     n_sub;
+
+  ffmpeg_posmap    posmap[POSMAP_SIZE]; // ring-buffer
+  unsigned int     posmap_cnt;
 } ffmpeg_audio_decoder;
 
 
@@ -92,23 +152,276 @@ static int ad_info_ffmpeg(void *sf, struct adinfo *nfo) {
   return 0;
 }
 
-static void *ad_open_ffmpeg(const char *fn, struct adinfo *nfo) {
-  ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) calloc(1, sizeof(ffmpeg_audio_decoder));
-  
+/* interleaved 16bit PCM in native byte-order can be used as-is,
+ * straight from the packet, bypassing the decoder.
+ * This saves CPU and a copy only, the amount of data read from the
+ * file is not affected (see the stream discard in ffmpeg_open()). */
+static int pcm_passthrough(AVCodecContext *cc) {
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(54, 0, 0)
+  if (cc->sample_fmt != AV_SAMPLE_FMT_S16) return 0;
+#endif
+#ifdef WORDS_BIGENDIAN
+  return cc->codec_id == AV_CODEC_ID_PCM_S16BE;
+#else
+  return cc->codec_id == AV_CODEC_ID_PCM_S16LE;
+#endif
+}
+
+static void codec_key_init(ffmpeg_codec_key *k, const AVCodecContext *cc) {
+  memset(k, 0, sizeof(ffmpeg_codec_key));
+  k->codec_id              = cc->codec_id;
+  k->sample_rate           = cc->sample_rate;
+  k->channels              = cc->channels;
+  k->channel_layout        = cc->channel_layout;
+  k->block_align           = cc->block_align;
+  k->bits_per_coded_sample = cc->bits_per_coded_sample;
+}
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(55, 52, 102)
+/* Codec contexts of closed files are kept and handed to the next file
+ * with the same parameters and codec extradata (multi-file runs over many
+ * short files of the same format skip decoder setup). The decoder uses its
+ * own copy of the stream's context, which outlives the format context. */
+#define CODEC_CACHE_SIZE (4)
+
+typedef struct {
+  AVCodecContext*  cc;
+  ffmpeg_codec_key key;
+} ffmpeg_codec_cache;
+
+static ffmpeg_codec_cache codec_cache[CODEC_CACHE_SIZE];
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t codec_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+# define CACHE_LOCK pthread_mutex_lock(&codec_cache_lock)
+# define CACHE_UNLOCK pthread_mutex_unlock(&codec_cache_lock)
+#else
+# define CACHE_LOCK
+# define CACHE_UNLOCK
+#endif
+
+static AVCodecContext *codec_acquire(AVCodec *codec, const ffmpeg_codec_key *key, const AVCodecContext *sc) {
+  AVCodecContext *cc = NULL;
+  int i;
+  CACHE_LOCK;
+  for (i = 0; i < CODEC_CACHE_SIZE; ++i) {
+    AVCodecContext *c = codec_cache[i].cc;
+    if (!c || memcmp(&codec_cache[i].key, key, sizeof(ffmpeg_codec_key))) continue;
+    if (c->extradata_size != sc->extradata_size) continue;
+    if (sc->extradata_size > 0 && memcmp(c->extradata, sc->extradata, sc->extradata_size)) continue;
+    cc = c;
+    codec_cache[i].cc = NULL;
+    break;
+  }
+  CACHE_UNLOCK;
+
+  if (cc) {
+    dbg(2, "ffmpeg - re-using codec context");
+    avcodec_flush_buffers(cc);
+    return cc;
+  }
+
+  cc = avcodec_alloc_context3(codec);
+  if (!cc) return NULL;
+  if (avcodec_copy_context(cc, sc) < 0 || avcodec_open2(cc, codec, NULL) < 0) {
+    avcodec_free_context(&cc);
+    return NULL;
+  }
+  return cc;
+}
+
+static void codec_release(AVCodecContext *cc, const ffmpeg_codec_key *key, int keep) {
+  int i;
+  if (!cc) return;
+  if (keep) {
+    CACHE_LOCK;
+    for (i = 0; i < CODEC_CACHE_SIZE; ++i) {
+      if (codec_cache[i].cc) continue;
+      codec_cache[i].cc = cc;
+      codec_cache[i].key = *key;
+      cc = NULL;
+      break;
+    }
+    CACHE_UNLOCK;
+    if (!cc) return;
+  }
+  avcodec_close(cc);
+  avcodec_free_context(&cc);
+}
+
+/** free the cached codec contexts, see adp_exit_ffmpeg() */
+static void codec_cache_clear(void) {
+  int i;
+  CACHE_LOCK;
+  for (i = 0; i < CODEC_CACHE_SIZE; ++i) {
+    if (!codec_cache[i].cc) continue;
+    avcodec_close(codec_cache[i].cc);
+    avcodec_free_context(&codec_cache[i].cc);
+  }
+  CACHE_UNLOCK;
+}
+
+#else /* old libavcodec, decode using the stream's context */
+
+static AVCodecContext *codec_acquire(AVCodec *codec, const ffmpeg_codec_key *key, AVCodecContext *sc) {
+  if (avcodec_open2(sc, codec, NULL) < 0) return NULL;
+  return sc;
+}
+
+static void codec_release(AVCodecContext *cc, const ffmpeg_codec_key *key, int keep) {
+  if (cc) avcodec_close(cc);
+}
+
+static void codec_cache_clear(void) { }
+#endif
+
+/* AVIOContext callbacks on top of ad_io */
+static int ffio_read(void *opaque, uint8_t *buf, int buf_size) {
+  ssize_t rv = ad_io_read((ad_io*) opaque, buf, buf_size);
+  if (rv == 0) return AVERROR_EOF;
+  return rv < 0 ? AVERROR(EIO) : (int) rv;
+}
+
+static int64_t ffio_seek(void *opaque, int64_t offset, int whence) {
+  if (whence & AVSEEK_SIZE) {
+    return ad_io_length((ad_io*) opaque);
+  }
+  return ad_io_seek((ad_io*) opaque, offset, whence & ~AVSEEK_FORCE);
+}
+
+/* remote resources (http, ...): every block is fetched with its own
+ * request for exactly that byte-range (the http protocol's "offset" and
+ * "end_offset" options), the server does not send more than is cached. */
+typedef struct {
+  char *url;
+} url_source;
+
+static ssize_t url_fetch(void *arg, int64_t offset, void *buf, size_t len) {
+  url_source *src = (url_source*) arg;
+  AVIOContext *up = NULL;
+  AVDictionary *opts = NULL;
+  char tmp[32];
+  size_t got = 0;
+  int rv;
+
+  snprintf(tmp, sizeof(tmp), "%" PRId64, offset);
+  av_dict_set(&opts, "offset", tmp, 0);
+  snprintf(tmp, sizeof(tmp), "%" PRId64, offset + (int64_t) len);
+  av_dict_set(&opts, "end_offset", tmp, 0);
+  rv = avio_open2(&up, src->url, AVIO_FLAG_READ, NULL, &opts);
+  av_dict_free(&opts);
+  if (rv < 0) {
+    return -1;
+  }
+  while (got < len) {
+    rv = avio_read(up, (unsigned char*)buf + got, len - got);
+    if (rv <= 0) break;
+    got += rv;
+  }
+  avio_closep(&up);
+  return got > 0 || len == 0 ? (ssize_t) got : -1;
+}
+
+static void url_release(void *arg) {
+  url_source *src = (url_source*) arg;
+  free(src->url);
+  free(src);
+}
+
+/** open a http(s) URL through a local block cache, see ad_io_open_cache().
+ * The cache size defaults to a fraction of the resource, the environment
+ * variable AD_CACHE_MB sets it in MiB.
+ * @return NULL for other protocols, and if the server does not support ranged requests
+ */
+static ad_io *url_open(const char *fn) {
+  AVIOContext *up = NULL;
+  url_source *src;
+  size_t cache_size = 0;
+  int64_t size;
+  ad_io *io;
+  if (strncmp(fn, "http://", 7) && strncmp(fn, "https://", 8)) {
+    return NULL;
+  }
+  const char *mb = getenv("AD_CACHE_MB");
+  if (mb && atoi(mb) > 0) {
+    cache_size = (size_t) atoi(mb) << 20;
+  }
+  /* probe size and range support, data is fetched with separate requests */
+  if (avio_open2(&up, fn, AVIO_FLAG_READ, NULL, NULL) < 0) {
+    return NULL;
+  }
+  size = up->seekable ? avio_size(up) : -1;
+  avio_closep(&up);
+  if (size <= 0) {
+    dbg(1, "ffmpeg - '%s' is not seekable, reading sequentially.", fn);
+    return NULL;
+  }
+  if (!(src = (url_source*) calloc(1, sizeof(url_source)))) {
+    return NULL;
+  }
+  if (!(src->url = strdup(fn))) {
+    free(src);
+    return NULL;
+  }
+  if (!(io = ad_io_open_cache(src, url_fetch, url_release, size, cache_size))) {
+    url_release(src);
+  }
+  return io;
+}
+
+/* release everything but the ad_io */
+static void ffmpeg_free(ffmpeg_audio_decoder *priv) {
+  ad_pool_free(priv->m_tmpBuffer);
+  free(priv->fn);
+  if (priv->formatContext) {
+    avformat_close_input(&priv->formatContext);
+  }
+  if (priv->avio) {
+    /* custom I/O contexts are not free'd by libavformat */
+    av_freep(&priv->avio->buffer);
+    av_freep(&priv->avio);
+  }
+  ad_pool_free(priv);
+}
+
+/** open file by name, or read from the given ad_io stream if io is not NULL.
+ * With io, fn is only used to guess the format (may be NULL). */
+static void *ffmpeg_open(const char *fn, ad_io *io, struct adinfo *nfo) {
+  ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) ad_pool_calloc(1, sizeof(ffmpeg_audio_decoder));
+  if (!priv) return NULL;
+
   priv->m_tmpBufferStart=NULL;
   priv->m_tmpBufferLen=0;
-  priv->decoder_clock=priv->output_clock=priv->seek_frame=0; 
+  priv->decoder_clock=priv->output_clock=0;
+  priv->seek_frame=-1;
+  priv->pkt_pts=AV_NOPTS_VALUE;
   priv->packet.size=0; priv->packet.data=NULL;
 
-  if (avformat_open_input(&priv->formatContext, fn, NULL, NULL) <0) {
-    dbg(0, "ffmpeg is unable to open file '%s'.", fn);
-    free(priv); return(NULL);
+  if (io) {
+    uint8_t *buf = (uint8_t*) av_malloc(AVIO_BUFSIZE);
+    priv->formatContext = avformat_alloc_context();
+    priv->avio = buf ? avio_alloc_context(buf, AVIO_BUFSIZE, 0, io, ffio_read, NULL, ffio_seek) : NULL;
+    if (!priv->formatContext || !priv->avio) {
+      if (!priv->avio) av_free(buf);
+      avformat_free_context(priv->formatContext);
+      priv->formatContext = NULL;
+      ffmpeg_free(priv); return(NULL);
+    }
+    priv->avio->seekable = ad_io_length(io) < 0 ? 0 : AVIO_SEEKABLE_NORMAL;
+    priv->formatContext->pb = priv->avio;
+    priv->formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+
+  if (avformat_open_input(&priv->formatContext, fn ? fn : "", NULL, NULL) <0) {
+    dbg(0, "ffmpeg is unable to open file '%s'.", fn ? fn : "(stream)");
+    ffmpeg_free(priv); return(NULL);
   }
+  priv->io = io;
+  if (fn) priv->fn = strdup(fn);
 
   if (avformat_find_stream_info(priv->formatContext, NULL) < 0) {
-    avformat_close_input(&priv->formatContext);
     dbg(0, "av_find_stream_info failed" );
-    free(priv); return(NULL);
+    ffmpeg_free(priv); return(NULL);
   }
 
   priv->audioStream = -1;
@@ -121,21 +434,30 @@ static void *ad_open_ffmpeg(const char *fn, struct adinfo *nfo) {
   }
   if (priv->audioStream == -1) {
     dbg(0, "No Audio Stream found in file");
-    avformat_close_input(&priv->formatContext);
-    free(priv); return(NULL);
+    ffmpeg_free(priv); return(NULL);
+  }
+
+  /* let the demuxer skip video, subtitle and data packets. Most demuxers
+   * (mov, matroska, mxf, ...) then seek over the payload instead of reading it.
+   * This is the only I/O reduction: the audio chunks themselves are still
+   * read through the demuxer, interleave is not rearranged. */
+  for (i=0; i<priv->formatContext->nb_streams; i++) {
+    if ((int)i != priv->audioStream) {
+      priv->formatContext->streams[i]->discard = AVDISCARD_ALL;
+    }
   }
 
-  priv->codecContext = priv->formatContext->streams[priv->audioStream]->codec;
-  priv->codec        = avcodec_find_decoder(priv->codecContext->codec_id);
+  AVCodecContext *sc = priv->formatContext->streams[priv->audioStream]->codec;
+  priv->codec = avcodec_find_decoder(sc->codec_id);
 
   if (priv->codec == NULL) {
-    avformat_close_input(&priv->formatContext);
     dbg(0, "Codec not supported by ffmpeg");
-    free(priv); return(NULL);
+    ffmpeg_free(priv); return(NULL);
   }
-  if (avcodec_open2(priv->codecContext, priv->codec, NULL) < 0) {
+  codec_key_init(&priv->codecKey, sc);
+  if (!(priv->codecContext = codec_acquire(priv->codec, &priv->codecKey, sc))) {
     dbg(0, "avcodec_open failed" );
-    free(priv); return(NULL);
+    ffmpeg_free(priv); return(NULL);
   }
 
   dbg(2, "ffmpeg - audio tics: %i/%i [sec]",priv->formatContext->streams[priv->audioStream]->time_base.num,priv->formatContext->streams[priv->audioStream]->time_base.den);
@@ -148,47 +470,276 @@ static void *ad_open_ffmpeg(const char *fn, struct adinfo *nfo) {
   priv->samplerate = priv->codecContext->sample_rate;
   priv->channels   = priv->codecContext->channels ;
   priv->length     = (int64_t)( len * priv->samplerate / AV_TIME_BASE );
+  priv->pcm_direct = pcm_passthrough(priv->codecContext);
 
   if (ad_info_ffmpeg((void*)priv, nfo)) {
     dbg(0, "invalid file info (sample-rate==0)");
-    free(priv); return(NULL);
+    codec_release(priv->codecContext, &priv->codecKey, 0);
+    ffmpeg_free(priv); return(NULL);
   }
 
-  dbg(1, "ffmpeg - %s", fn);
+  dbg(1, "ffmpeg - %s", fn ? fn : "(stream)");
   if (nfo) 
     dbg(1, "ffmpeg - sr:%i c:%i d:%"PRIi64" f:%"PRIi64, nfo->sample_rate, nfo->channels, nfo->length, nfo->frames);
 
   return (void*) priv;
 }
 
+static void *ad_open_ffmpeg(const char *fn, struct adinfo *nfo) {
+  ad_io *io = url_open(fn);
+  if (io) {
+    void *priv = ffmpeg_open(fn, io, nfo);
+    if (!priv) ad_io_close(io);
+    return priv;
+  }
+  return ffmpeg_open(fn, NULL, nfo);
+}
+
+static void *ad_open_io_ffmpeg(ad_io *io, struct adinfo *nfo) {
+  return ffmpeg_open(NULL, io, nfo);
+}
+
 static int ad_close_ffmpeg(void *sf) {
   ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) sf;
   if (!priv) return -1;
-  avcodec_close(priv->codecContext);
-  avformat_close_input(&priv->formatContext);
-  free(priv);
+  ad_io *io = priv->io;
+  unsigned int i;
+  for (i = 0; i < priv->n_sub; ++i) {
+    if (priv->sub[i].codecContext != priv->codecContext) {
+      avcodec_close(priv->sub[i].codecContext);
+    }
+    ad_pool_free(priv->sub[i].buf);
+  }
+  ad_pool_free(priv->sub);
+  if (priv->packet.data) av_free_packet(&priv->packet);
+  codec_release(priv->codecContext, &priv->codecKey, 1);
+  ffmpeg_free(priv);
+  ad_io_close(io);
   return 0;
 }
 
-static void int16_to_float(int16_t *in, float *out, int num_channels, int num_samples, int out_offset) {
-  int i,ii;
-  for (i=0;i<num_samples;i++) {
-    for (ii=0;ii<num_channels;ii++) {
-     out[(i+out_offset)*num_channels+ii]= (float) in[i*num_channels+ii]/ 32768.0;
+/* sample conversion - interleaved data is contiguous, so this
+ * is a single flat loop which vectorizes well */
+#define INT16_TO_FLOAT(NAME, ATTR) \
+static ATTR void NAME(int16_t *in, float *out, int num_channels, int num_samples, int out_offset) { \
+  int i; \
+  const int n = num_samples * num_channels; \
+  float * const o = out + out_offset * num_channels; \
+  for (i=0;i<n;i++) { \
+    o[i] = (float) in[i] / 32768.0; \
+  } \
+}
+
+INT16_TO_FLOAT(int16_to_float_generic, )
+#ifdef AD_SIMD_DISPATCH
+INT16_TO_FLOAT(int16_to_float_sse2, AD_TARGET_SSE2)
+INT16_TO_FLOAT(int16_to_float_avx2, AD_TARGET_AVX2)
+INT16_TO_FLOAT(int16_to_float_avx512, AD_TARGET_AVX512)
+#endif
+
+/* set by adp_get_ffmpeg() */
+static void (*int16_to_float)(int16_t *, float *, int, int, int) = int16_to_float_generic;
+
+/** (re)allocate a staging buffer to hold at least the given number of bytes.
+ * Any data in the buffer is discarded.
+ */
+static int16_t *staging_buffer(int16_t **buf, size_t *size, size_t bytes) {
+  if (*buf && *size >= bytes) return *buf;
+  ad_pool_free(*buf);
+  *buf = (int16_t*) ad_pool_alloc(bytes);
+  *size = *buf ? bytes : 0;
+  if (*buf) dbg(2, "staging buffer: %lu bytes", (unsigned long) bytes);
+  return *buf;
+}
+
+/** decode one chunk of the packet into interleaved int16 samples.
+ * The output buffer is grown to the size of the decoded frame, as needed.
+ * @param buf output buffer, may be reallocated
+ * @param bufsize size of buf in bytes
+ * @param data_size set to the number of decoded bytes
+ * @return number of bytes consumed from the packet, or -1 on error
+ */
+static int decode_chunk(AVCodecContext *cc, AVPacket *pkt, int16_t **buf, size_t *bufsize, int *data_size) {
+  int ret;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(54, 0, 0)
+  // TODO use av_frame_alloc() and av_frame_free() with newer ffmpeg
+  AVFrame avf;
+  memset(&avf, 0, sizeof(AVFrame));
+  int got_frame = 0;
+  ret = avcodec_decode_audio4(cc, &avf, &got_frame, pkt);
+  if (ret >= 0 && got_frame) {
+    int ch, plane_size;
+    const int planar = av_sample_fmt_is_planar(cc->sample_fmt);
+    *data_size = av_samples_get_buffer_size(&plane_size, cc->channels, avf.nb_samples, cc->sample_fmt, 1);
+    int16_t *out = *data_size > 0 ? staging_buffer(buf, bufsize, *data_size) : NULL;
+    if (!out) {
+      ret = -1;
+    } else {
+      memcpy(out, avf.extended_data[0], plane_size);
+      if (planar && cc->channels > 1) {
+        uint8_t *dst = ((uint8_t *)out) + plane_size;
+        for (ch = 1; ch < cc->channels; ch++) {
+          memcpy(dst, avf.extended_data[ch], plane_size);
+          dst += plane_size;
+        }
+      }
     }
+  } else {
+    ret = -1;
+  }
+#elif LIBAVUTIL_VERSION_INT > AV_VERSION_INT(49, 15, 0) && LIBAVCODEC_VERSION_INT > AV_VERSION_INT(52, 20, 1) // ??
+  // this was deprecated in LIBAVCODEC_VERSION_MAJOR 53
+  if (!staging_buffer(buf, bufsize, AVCODEC_MAX_AUDIO_FRAME_SIZE)) return -1;
+  *data_size = AVCODEC_MAX_AUDIO_FRAME_SIZE;
+  ret = avcodec_decode_audio3(cc,
+      *buf, data_size, pkt);
+#else
+  int len = pkt->size;
+  uint8_t *ptr = pkt->data;
+  if (!staging_buffer(buf, bufsize, AVCODEC_MAX_AUDIO_FRAME_SIZE)) return -1;
+  *data_size = AVCODEC_MAX_AUDIO_FRAME_SIZE;
+  ret = avcodec_decode_audio2(cc,
+      *buf, data_size, ptr, len);
+#endif
+  return ret;
+}
+
+static int64_t pts_to_frames(ffmpeg_audio_decoder *priv, int64_t pts) {
+  const AVRational sr = { 1, priv->samplerate };
+  return av_rescale_q(pts, priv->formatContext->streams[priv->audioStream]->time_base, sr);
+}
+
+/** number of frames to decode ahead of a seek target. Output of most
+ * codecs depends on previous packets (overlapping transforms, MP3 bit
+ * reservoir, Opus/Vorbis pre-roll); PCM-like codecs decode independently.
+ */
+static int64_t seek_preroll(ffmpeg_audio_decoder *priv) {
+  const AVCodecContext *cc = priv->codecContext;
+  if (priv->pcm_direct || av_get_bits_per_sample(cc->codec_id) > 0) {
+    return 0;
+  }
+  int64_t preroll = 4 * (cc->frame_size > 0 ? cc->frame_size : 2048);
+  if (preroll < priv->samplerate / 10) {
+    preroll = priv->samplerate / 10;
+  }
+  return preroll;
+}
+
+static void ffmpeg_flush(ffmpeg_audio_decoder *priv) {
+  priv->m_tmpBufferLen = 0;
+  priv->pkt_len = 0; priv->pkt_ptr = NULL;
+  priv->pkt_pts = AV_NOPTS_VALUE;
+  avcodec_flush_buffers(priv->codecContext);
+}
+
+/** seek to the start of the stream, samples are counted from there */
+static int ffmpeg_seek_rewind(ffmpeg_audio_decoder *priv) {
+  AVStream *st = priv->formatContext->streams[priv->audioStream];
+  const int64_t ts = st->start_time != AV_NOPTS_VALUE ? st->start_time : 0;
+  ffmpeg_flush(priv);
+  priv->decoder_clock = 0;
+  if (av_seek_frame(priv->formatContext, priv->audioStream, ts, AVSEEK_FLAG_BACKWARD) < 0
+      && av_seek_frame(priv->formatContext, -1, 0, AVSEEK_FLAG_BYTE) < 0) {
+    dbg(0, "ffmpeg - can not seek to start of file.");
+    return -1;
+  }
+  return 0;
+}
+
+/** seek to a packet at or before the given sample, the read
+ * callback decodes and discards up to priv->seek_frame. */
+static int ffmpeg_seek_to(ffmpeg_audio_decoder *priv, int64_t target) {
+  if (target <= 0 || priv->pts_state == 0) {
+    return ffmpeg_seek_rewind(priv);
+  }
+  const AVRational sr = { 1, priv->samplerate };
+  const int64_t timestamp = av_rescale_q(target + priv->pts_base, sr, priv->formatContext->streams[priv->audioStream]->time_base);
+  dbg(2, "seek frame:%"PRIi64" - idx:%"PRIi64, target, timestamp);
+
+  ffmpeg_flush(priv);
+  priv->decoder_clock = -1;
+  if (av_seek_frame(priv->formatContext, priv->audioStream, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+    return ffmpeg_seek_rewind(priv);
+  }
+  return 0;
+}
+
+/** the demuxer landed after the target, retry with a larger margin
+ * and eventually decode from the start.
+ * @return 0 on success, -1 if the demuxer position is unknown */
+static int ffmpeg_seek_retry(ffmpeg_audio_decoder *priv) {
+  int64_t margin = seek_preroll(priv) + priv->samplerate;
+  if (++priv->seek_retry > 3) {
+    return ffmpeg_seek_rewind(priv);
   }
+  margin <<= 2 * priv->seek_retry;
+  /* falls back to decoding from the start */
+  return ffmpeg_seek_to(priv, priv->seek_frame - margin);
+}
+
+/** a pending seek can not be completed: do not decode from an unknown position */
+static void ffmpeg_seek_failed(ffmpeg_audio_decoder *priv) {
+  dbg(0, "ffmpeg - seek to frame %"PRIi64" failed.", priv->seek_frame);
+  ffmpeg_flush(priv);
+  priv->seek_frame = -1;
+  priv->seek_error = 1;
+}
+
+static ssize_t ad_read_ffmpeg(void *sf, float* d, size_t len);
+
+/** decode from the start of the file until the mapping of
+ * timestamps to samples (encoder delay, decoder delay) is known.
+ */
+static void ffmpeg_calibrate(ffmpeg_audio_decoder *priv) {
+  float *scratch = (float*) ad_pool_alloc(1024 * priv->channels * sizeof(float));
+  if (!scratch) return;
+  priv->seek_frame = -1;
+  if (!ffmpeg_seek_rewind(priv)) {
+    priv->output_clock = 0;
+    while (priv->pts_state < 2 && priv->output_clock < priv->samplerate) {
+      if (ad_read_ffmpeg(priv, scratch, 1024 * priv->channels) <= 0) break;
+    }
+  }
+  ad_pool_free(scratch);
+  dbg(1, "ffmpeg - timestamps %s.", priv->pts_state == 2 ? "calibrated" : priv->pts_state == 1 ? "assumed" : "unavailable");
+}
+
+/** remember the file position of a packet that was read.
+ * Packets are keyed by their timestamp, not by the samples the decoder
+ * returns while it is fed: decoders with delay return samples of
+ * earlier packets. */
+static void posmap_add(ffmpeg_audio_decoder *priv, AVPacket const *pkt) {
+  ffmpeg_posmap *prev = priv->posmap_cnt > 0 ? &priv->posmap[(priv->posmap_cnt - 1) % POSMAP_SIZE] : NULL;
+  int64_t frame;
+  if (pkt->pos < 0) return;
+  if (pkt->pts != AV_NOPTS_VALUE) {
+    frame = pts_to_frames(priv, pkt->pts);
+  } else if (prev && prev->n > 0 && prev->pos + prev->size == pkt->pos) {
+    /* continues the previous packet */
+    frame = prev->frame + prev->n;
+  } else {
+    return;
+  }
+  if (prev && prev->n == 0 && prev->pos < pkt->pos && frame > prev->frame) {
+    prev->n = frame - prev->frame;
+  }
+  ffmpeg_posmap *p = &priv->posmap[priv->posmap_cnt++ % POSMAP_SIZE];
+  p->frame = frame;
+  p->n = pkt->duration > 0 ? pts_to_frames(priv, pkt->duration) : 0;
+  p->pos = pkt->pos;
+  p->size = pkt->size;
 }
 
 static ssize_t ad_read_ffmpeg(void *sf, float* d, size_t len) {
   ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) sf;
-  if (!priv) return -1;
+  if (!priv || priv->seek_error) return -1;
   size_t frames = len / priv->channels;
 
   size_t written = 0;
   ssize_t ret = 0;
   while (ret >= 0 && written < frames) {
     dbg(3,"loop: %i/%i (bl:%lu)",written, frames, priv->m_tmpBufferLen );
-    if (priv->seek_frame == 0 && priv->m_tmpBufferLen > 0 ) {
+    if (priv->seek_frame < 0 && priv->m_tmpBufferLen > 0 ) {
       int s = MIN(priv->m_tmpBufferLen / priv->channels, frames - written );
       int16_to_float(priv->m_tmpBufferStart, d, priv->channels, s , written);
       written += s;
@@ -207,6 +758,10 @@ static ssize_t ad_read_ffmpeg(void *sf, float* d, size_t len) {
         if (ret<0) { dbg(1, "reached end of file."); break; }
         priv->pkt_len = priv->packet.size;
         priv->pkt_ptr = priv->packet.data;
+        priv->pkt_pts = priv->packet.pts;
+        if (priv->packet.stream_index == priv->audioStream) {
+          posmap_add(priv, &priv->packet);
+        }
       }
 
       if (priv->packet.stream_index != priv->audioStream) {
@@ -215,41 +770,16 @@ static ssize_t ad_read_ffmpeg(void *sf, float* d, size_t len) {
       }
 
       /* decode all chunks in packet */
-      int data_size = AVCODEC_MAX_AUDIO_FRAME_SIZE;
-
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(54, 0, 0)
-      // TODO use av_frame_alloc() and av_frame_free() with newer ffmpeg
-      AVFrame avf;
-      memset(&avf, 0, sizeof(AVFrame));
-      int got_frame = 0;
-      ret = avcodec_decode_audio4(priv->codecContext, &avf, &got_frame, &priv->packet);
-      if (ret >= 0 && got_frame) {
-        int ch, plane_size;
-        const int planar = av_sample_fmt_is_planar(priv->codecContext->sample_fmt);
-        data_size = av_samples_get_buffer_size(&plane_size, priv->codecContext->channels, avf.nb_samples, priv->codecContext->sample_fmt, 1);
-        if (data_size <= AVCODEC_MAX_AUDIO_FRAME_SIZE) {
-          memcpy(priv->m_tmpBuffer, avf.extended_data[0], plane_size);
-          if (planar && priv->codecContext->channels > 1) {
-            uint8_t *out = ((uint8_t *)priv->m_tmpBuffer) + plane_size;
-            for (ch = 1; ch < priv->codecContext->channels; ch++) {
-              memcpy(out, avf.extended_data[ch], plane_size);
-              out += plane_size;
-            }
-          }
-        }
+      int data_size = 0;
+      if (priv->pcm_direct) {
+        /* use the packet's payload in place, whole frames only */
+        data_size = priv->pkt_len - priv->pkt_len % (2 * priv->channels);
+        ret = priv->pkt_len;
+        priv->m_tmpBufferStart = (int16_t*) priv->pkt_ptr;
       } else {
-        ret = -1;
+        ret = decode_chunk(priv->codecContext, &priv->packet, &priv->m_tmpBuffer, &priv->m_tmpBufferSize, &data_size);
+        priv->m_tmpBufferStart = priv->m_tmpBuffer;
       }
-#elif LIBAVUTIL_VERSION_INT > AV_VERSION_INT(49, 15, 0) && LIBAVCODEC_VERSION_INT > AV_VERSION_INT(52, 20, 1) // ??
-      // this was deprecated in LIBAVCODEC_VERSION_MAJOR 53
-      ret = avcodec_decode_audio3(priv->codecContext,
-          priv->m_tmpBuffer, &data_size, &priv->packet);
-#else
-      int len = priv->packet.size;
-      uint8_t *ptr = priv->packet.data;
-      ret = avcodec_decode_audio2(priv->codecContext,
-          priv->m_tmpBuffer, &data_size, ptr, len);
-#endif
 
       if (ret < 0 || ret > priv->pkt_len) {
 #if 0
@@ -263,46 +793,64 @@ static ssize_t ad_read_ffmpeg(void *sf, float* d, size_t len) {
 
       priv->pkt_len -= ret; priv->pkt_ptr += ret;
 
-      /* sample exact alignment  */
-      if (priv->packet.pts != AV_NOPTS_VALUE) {
-        priv->decoder_clock = priv->samplerate * av_q2d(priv->formatContext->streams[priv->audioStream]->time_base) * priv->packet.pts;
-      } else {
-        dbg(0, "!!! NO PTS timestamp in file");
-        priv->decoder_clock += (data_size>>1) / priv->channels;
+      if (data_size <= 0) {
+        continue;
       }
+      priv->m_tmpBufferLen+= (data_size>>1); // 2 bytes per sample
+      const int64_t n_frames = (data_size>>1) / priv->channels;
 
-      if (data_size>0) {
-        priv->m_tmpBufferLen+= (data_size>>1); // 2 bytes per sample
+      /* the first output of a packet is located using the packet's
+       * timestamp. Decoders with delay return data of earlier packets,
+       * the offset is the same for all packets and part of pts_base. */
+      int64_t pf = AV_NOPTS_VALUE;
+      if (priv->pkt_pts != AV_NOPTS_VALUE) {
+        pf = pts_to_frames(priv, priv->pkt_pts);
+        priv->pkt_pts = AV_NOPTS_VALUE;
+      }
+
+      if (priv->seek_frame < 0) {
+        /* sequential decoding, learn how timestamps map to samples */
+        if (pf != AV_NOPTS_VALUE && priv->pts_state < 2) {
+          priv->pts_base = pf - priv->output_clock;
+          /* the first packet may be shortened by the encoder delay */
+          priv->pts_state = priv->output_clock > 0 ? 2 : 1;
+          if (priv->pts_state == 2)
+            dbg(2, "ffmpeg - sample 0 at stream-time %"PRIi64" [frames]", priv->pts_base);
+        }
+        continue;
       }
 
       /* align buffer after seek. */
-      if (priv->seek_frame > 0) { 
-        const int diff = priv->output_clock-priv->decoder_clock;
-        if (diff<0) { 
-          /* seek ended up past the wanted sample */
-          dbg(0, " !!! Audio seek failed.");
+      if (priv->decoder_clock < 0) {
+        if (pf == AV_NOPTS_VALUE) {
+          dbg(1, "no timestamp after seek, decoding from the start.");
+          if (ffmpeg_seek_rewind(priv)) {
+            ffmpeg_seek_failed(priv);
+            return -1;
+          }
+          continue;
+        }
+        priv->decoder_clock = pf - priv->pts_base;
+      }
+
+      const int64_t diff = priv->seek_frame - priv->decoder_clock;
+      if (diff < 0) {
+        /* seek ended up past the wanted sample, go further back */
+        dbg(2, "seek overshoot by %"PRIi64" frames.", -diff);
+        if (ffmpeg_seek_retry(priv)) {
+          ffmpeg_seek_failed(priv);
           return -1;
-        } else if (priv->m_tmpBufferLen < (diff*priv->channels)) {
-          /* wanted sample not in current buffer - keep going */
-          dbg(2, " !!! seeked sample was not in decoded buffer. frames-to-go: %li", diff);
-          priv->m_tmpBufferLen = 0;
-        } else if (diff!=0 && data_size > 0) {
-          /* wanted sample is in current buffer but not at the beginnning */
-          dbg(2, " !!! sync buffer to seek. (diff:%i)", diff);
-          priv->m_tmpBufferStart+= diff*priv->codecContext->channels;
-          priv->m_tmpBufferLen  -= diff*priv->codecContext->channels;
-#if 1
-          memmove(priv->m_tmpBuffer, priv->m_tmpBufferStart, priv->m_tmpBufferLen);
-          priv->m_tmpBufferStart = priv->m_tmpBuffer;
-#endif
-          priv->seek_frame=0;
-          priv->decoder_clock += diff;
-        } else if (data_size > 0) {
-          dbg(2, "Audio exact sync-seek (%"PRIi64" == %"PRIi64")", priv->decoder_clock, priv->seek_frame);
-          priv->seek_frame=0;
-        } else {
-          dbg(0, "Error: no audio data in packet");
         }
+      } else if (diff >= n_frames) {
+        /* pre-roll, decode and discard */
+        priv->decoder_clock += n_frames;
+        priv->m_tmpBufferLen = 0;
+      } else {
+        dbg(2, "Audio exact sync-seek (%"PRIi64" + %"PRIi64")", priv->decoder_clock, diff);
+        priv->m_tmpBufferStart += diff * priv->channels;
+        priv->m_tmpBufferLen   -= diff * priv->channels;
+        priv->decoder_clock = priv->seek_frame;
+        priv->seek_frame = -1;
       }
       //dbg(0, "PTS: decoder:%"PRIi64". - want: %"PRIi64, priv->decoder_clock, priv->output_clock);
       //dbg(0, "CLK: frame:  %"PRIi64"  T:%.3fs",priv->decoder_clock, (float) priv->decoder_clock/priv->samplerate);
@@ -314,32 +862,362 @@ static ssize_t ad_read_ffmpeg(void *sf, float* d, size_t len) {
   return written * priv->channels;
 }
 
+/** enable decoding of all audio streams.
+ * Streams that can not be decoded are skipped.
+ * @return number of audio streams
+ */
+static int ad_streams_ffmpeg(void *sf, struct adinfo *nfo, int *index, int max) {
+  ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) sf;
+  if (!priv) return -1;
+  unsigned int i;
+
+  if (!priv->sub) {
+    priv->sub = (ffmpeg_substream*) ad_pool_calloc(priv->formatContext->nb_streams, sizeof(ffmpeg_substream));
+    if (!priv->sub) return -1;
+
+    for (i=0; i<priv->formatContext->nb_streams; i++) {
+      AVCodecContext *cc = priv->formatContext->streams[i]->codec;
+      if (cc->codec_type != AVMEDIA_TYPE_AUDIO) {
+        continue;
+      }
+      if ((int)i != priv->audioStream) {
+        AVCodec *codec = avcodec_find_decoder(cc->codec_id);
+        if (!codec || avcodec_open2(cc, codec, NULL) < 0) {
+          dbg(0, "Codec of stream %d not supported by ffmpeg", i);
+          continue;
+        }
+        if (cc->sample_rate == 0 || cc->channels == 0) {
+          dbg(0, "invalid stream %d info (sample-rate==0)", i);
+          avcodec_close(cc);
+          continue;
+        }
+      }
+      ffmpeg_substream *ss = &priv->sub[priv->n_sub];
+      priv->formatContext->streams[i]->discard = AVDISCARD_DEFAULT;
+      ss->index = i;
+      ss->codecContext = (int)i == priv->audioStream ? priv->codecContext : cc;
+      ss->bufStart = ss->buf;
+      ss->bufLen = 0;
+      priv->n_sub++;
+    }
+    /* packets are dispatched to all streams from now on */
+    priv->m_tmpBufferLen = 0;
+    priv->pkt_len = 0; priv->pkt_ptr = NULL;
+  }
+
+  const int64_t len = priv->formatContext->duration - priv->formatContext->start_time;
+  for (i = 0; i < priv->n_sub && (int)i < max; ++i) {
+    AVCodecContext *cc = priv->sub[i].codecContext;
+    if (index) index[i] = priv->sub[i].index;
+    if (!nfo) continue;
+    nfo[i].sample_rate = cc->sample_rate;
+    nfo[i].channels    = cc->channels;
+    nfo[i].frames      = (int64_t)( len * cc->sample_rate / AV_TIME_BASE );
+    nfo[i].length      = (nfo[i].frames * 1000) / nfo[i].sample_rate;
+    nfo[i].bit_rate    = cc->bit_rate;
+    nfo[i].bit_depth   = 0;
+    nfo[i].meta_data   = NULL;
+  }
+  return priv->n_sub;
+}
+
+/** demux packets of all audio streams and return decoded data of
+ * one stream at a time, in file order */
+static ssize_t ad_read_stream_ffmpeg(void *sf, float* d, size_t len, int *stream) {
+  ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) sf;
+  if (!priv || !priv->sub) return -1;
+  unsigned int i;
+
+  while (1) {
+    /* return pending decoded data first */
+    for (i = 0; i < priv->n_sub; ++i) {
+      ffmpeg_substream *ss = &priv->sub[i];
+      const int channels = ss->codecContext->channels;
+      if (ss->bufLen < (unsigned long) channels) continue;
+      const int s = MIN(ss->bufLen / channels, len / channels);
+      if (s < 1) return -1;
+      int16_to_float(ss->bufStart, d, channels, s, 0);
+      ss->bufStart += s * channels;
+      ss->bufLen   -= s * channels;
+      if (stream) *stream = i;
+      return s * channels;
+    }
+
+    if (!priv->pkt_ptr || priv->pkt_len < 1) {
+      if (priv->packet.data) av_free_packet(&priv->packet);
+      if (av_read_frame(priv->formatContext, &priv->packet) < 0) {
+        dbg(1, "reached end of file.");
+        return 0;
+      }
+      priv->pkt_len = priv->packet.size;
+      priv->pkt_ptr = priv->packet.data;
+    }
+
+    ffmpeg_substream *ss = NULL;
+    for (i = 0; i < priv->n_sub; ++i) {
+      if (priv->sub[i].index == priv->packet.stream_index) {
+        ss = &priv->sub[i];
+        break;
+      }
+    }
+    if (!ss) {
+      priv->pkt_ptr = NULL;
+      continue;
+    }
+
+    AVPacket pkt = priv->packet;
+    pkt.data = priv->pkt_ptr;
+    pkt.size = priv->pkt_len;
+
+    int data_size = 0;
+    if (pcm_passthrough(ss->codecContext)) {
+      /* the packet is only released once all buffers are drained */
+      ss->bufStart = (int16_t*) priv->pkt_ptr;
+      ss->bufLen = (priv->pkt_len - priv->pkt_len % (2 * ss->codecContext->channels)) >> 1;
+      priv->pkt_len = 0;
+      continue;
+    }
+
+    int ret = decode_chunk(ss->codecContext, &pkt, &ss->buf, &ss->bufSize, &data_size);
+    if (ret < 0 || ret > priv->pkt_len) {
+      priv->pkt_len = 0;
+      continue;
+    }
+    priv->pkt_len -= ret; priv->pkt_ptr += ret;
+
+    ss->bufStart = ss->buf;
+    ss->bufLen = data_size > 0 ? (data_size>>1) : 0;
+  }
+}
+
 static int64_t ad_seek_ffmpeg(void *sf, int64_t pos) {
   ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) sf;
   if (!sf) return -1;
-  if (pos == priv->output_clock) return pos;
+  if (pos == priv->output_clock && !priv->seek_error) return pos;
+  if (pos < 0) return -1;
+
+  const int64_t preroll = seek_preroll(priv);
+  if (priv->pts_state == 0 && pos > preroll) {
+    ffmpeg_calibrate(priv);
+  }
 
-  /* flush internal buffer */
-  priv->m_tmpBufferLen = 0;
   priv->seek_frame = pos;
+  priv->seek_retry = 0;
+  priv->seek_error = 0;
   priv->output_clock = pos;
-  priv->pkt_len = 0; priv->pkt_ptr = NULL;
-  priv->decoder_clock = 0;
+  if (ffmpeg_seek_to(priv, pos - preroll)) {
+    priv->seek_frame = -1;
+    return -1;
+  }
+  return pos;
+}
 
-#if 0
-  /* TODO seek at least 1 packet before target.
-   * for mpeg compressed files, the
-   * output may depend on past frames! */
-  if (pos > 8192) pos -= 8192;
-  else pos = 0;
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(54, 0, 0)
+/** open an output file for stream-copy of the given input stream */
+static AVFormatContext *remux_open(AVStream *ist, const char *fn) {
+  AVFormatContext *oc = NULL;
+  AVStream *ost;
+  if (avformat_alloc_output_context2(&oc, NULL, NULL, fn) < 0 || !oc) {
+    dbg(0, "ffmpeg can not write '%s'.", fn);
+    return NULL;
+  }
+  if (!(ost = avformat_new_stream(oc, NULL)) || avcodec_copy_context(ost->codec, ist->codec) < 0) {
+    avformat_free_context(oc);
+    return NULL;
+  }
+  ost->codec->codec_tag = 0;
+  ost->time_base = ist->time_base;
+  if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
+    ost->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+  }
+  if (!(oc->oformat->flags & AVFMT_NOFILE) && avio_open(&oc->pb, fn, AVIO_FLAG_WRITE) < 0) {
+    avformat_free_context(oc);
+    return NULL;
+  }
+  if (avformat_write_header(oc, NULL) < 0) {
+    if (!(oc->oformat->flags & AVFMT_NOFILE)) avio_close(oc->pb);
+    avformat_free_context(oc);
+    unlink(fn);
+    return NULL;
+  }
+  return oc;
+}
+
+static int remux_close(AVFormatContext *oc, const char *fn, int rv) {
+  if (av_write_trailer(oc) < 0) rv = -1;
+  if (!(oc->oformat->flags & AVFMT_NOFILE)) avio_close(oc->pb);
+  avformat_free_context(oc);
+  if (rv) unlink(fn);
+  return rv;
+}
+
+/** write an input packet to an output, timestamps relative to offset.
+ * The outputs have a single stream, av_write_frame() does not take
+ * ownership of the packet, so the same packet can go to several outputs. */
+static int remux_write(AVFormatContext *oc, AVStream *ist, AVPacket const *in, int64_t offset) {
+  AVStream *ost = oc->streams[0];
+  AVPacket pkt = *in;
+  /* each file starts at zero */
+  if (pkt.pts != AV_NOPTS_VALUE) pkt.pts = av_rescale_q(pkt.pts - offset, ist->time_base, ost->time_base);
+  if (pkt.dts != AV_NOPTS_VALUE) pkt.dts = av_rescale_q(pkt.dts - offset, ist->time_base, ost->time_base);
+  pkt.duration = av_rescale_q(pkt.duration, ist->time_base, ost->time_base);
+  pkt.pos = -1;
+  pkt.stream_index = 0;
+  return av_write_frame(oc, &pkt) < 0 ? -1 : 0;
+}
 #endif
 
-  const int64_t timestamp = pos / av_q2d(priv->formatContext->streams[priv->audioStream]->time_base) / priv->samplerate;
-  dbg(2, "seek frame:%"PRIi64" - idx:%"PRIi64, pos, timestamp);
-  
-  av_seek_frame(priv->formatContext, priv->audioStream, timestamp, AVSEEK_FLAG_ANY | AVSEEK_FLAG_BACKWARD);
-  avcodec_flush_buffers(priv->codecContext);
-  return pos;
+/** remux packets containing the given ranges of frames, no re-encoding.
+ * The input is read once, outputs are opened and closed as the ranges
+ * are reached. A packet that spans the boundary of ranges is written
+ * to every range it overlaps. */
+static int ad_copy_ffmpeg(void *sf, const char * const *fn, int64_t const *start, int64_t const *end, int n) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(54, 0, 0)
+  ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) sf;
+  AVFormatContext *ic = NULL;
+  AVFormatContext **oc;
+  int64_t *offset;
+  AVStream *ist;
+  AVPacket pkt;
+  int j, k = 0;
+  int rv = 0;
+
+  if (!priv || !priv->fn) return -1;
+  memset(&pkt, 0, sizeof(AVPacket));
+
+  oc = (AVFormatContext**) calloc(n, sizeof(AVFormatContext*));
+  offset = (int64_t*) malloc(n * sizeof(int64_t));
+  if (!oc || !offset) {
+    free(oc); free(offset);
+    return -1;
+  }
+  for (j = 0; j < n; ++j) {
+    offset[j] = AV_NOPTS_VALUE;
+  }
+
+  /* use a separate demuxer, the decoder's position is not affected */
+  if (avformat_open_input(&ic, priv->fn, NULL, NULL) < 0) {
+    free(oc); free(offset);
+    return -1;
+  }
+  if (avformat_find_stream_info(ic, NULL) < 0) {
+    avformat_close_input(&ic);
+    free(oc); free(offset);
+    return -1;
+  }
+  ist = ic->streams[priv->audioStream];
+
+  /* frame-position to stream-time, see ad_read_ffmpeg() */
+  const AVRational sr = { 1, priv->samplerate };
+  int64_t base = 0;
+  if (priv->pts_state > 0) {
+    base = priv->pts_base;
+  } else if (ist->start_time != AV_NOPTS_VALUE) {
+    base = av_rescale_q(ist->start_time, ist->time_base, sr);
+  }
+#define TS(F) av_rescale_q((F) + base, sr, ist->time_base)
+
+  if (start[0] > 0) {
+    av_seek_frame(ic, priv->audioStream, TS(start[0]), AVSEEK_FLAG_BACKWARD);
+  }
+
+  while (k < n && !rv && av_read_frame(ic, &pkt) >= 0) {
+    const int64_t ts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+    if (pkt.stream_index != priv->audioStream) {
+      av_free_packet(&pkt);
+      continue;
+    }
+    if (ts == AV_NOPTS_VALUE) {
+      /* belongs to the current range, if it was started */
+      if (oc[k]) rv = remux_write(oc[k], ist, &pkt, offset[k]);
+      av_free_packet(&pkt);
+      continue;
+    }
+
+    /* done with the current range(s) */
+    while (k < n && ts >= TS(end[k])) {
+      if (!oc[k]) {
+        /* empty range, write an empty file */
+        oc[k] = remux_open(ist, fn[k]);
+      }
+      rv |= oc[k] ? remux_close(oc[k], fn[k], 0) : -1;
+      oc[k] = NULL;
+      ++k;
+    }
+
+    /* all ranges the packet overlaps, ranges are sorted */
+    const int64_t last = ts + (pkt.duration > 0 ? pkt.duration : 1);
+    for (j = k; j < n && !rv && TS(start[j]) < last; ++j) {
+      if (!oc[j] && !(oc[j] = remux_open(ist, fn[j]))) {
+        rv = -1;
+        break;
+      }
+      if (offset[j] == AV_NOPTS_VALUE) offset[j] = ts;
+      rv = remux_write(oc[j], ist, &pkt, offset[j]);
+    }
+    av_free_packet(&pkt);
+  }
+#undef TS
+
+  /* the ranges that were started extend to the end of the file,
+   * ranges past the end of the file are empty */
+  for (; k < n; ++k) {
+    if (!oc[k] && !rv) {
+      oc[k] = remux_open(ist, fn[k]);
+      if (!oc[k]) rv = -1;
+    }
+    if (oc[k]) rv |= remux_close(oc[k], fn[k], rv);
+  }
+  avformat_close_input(&ic);
+  free(oc);
+  free(offset);
+  return rv ? -1 : 0;
+#else
+  return -1;
+#endif
+}
+
+/** position of the packet that contains the given sample,
+ * or of the end of the packet that precedes it.
+ * Samples are mapped to stream-time using the calibrated pts_base. */
+static int64_t ad_byte_offset_ffmpeg(void *sf, int64_t frame) {
+  ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) sf;
+  if (!priv || priv->pts_state == 0) return -1;
+  const unsigned int n = MIN(priv->posmap_cnt, POSMAP_SIZE);
+  const int64_t ts = frame + priv->pts_base;
+  int64_t rv = -1;
+  unsigned int i;
+  for (i = 1; i <= n; ++i) {
+    ffmpeg_posmap const *p = &priv->posmap[(priv->posmap_cnt - i) % POSMAP_SIZE];
+    if (p->n == 0) continue;
+    if (ts >= p->frame && ts < p->frame + p->n) {
+      return p->pos;
+    }
+    if (ts == p->frame + p->n && rv < 0) {
+      rv = p->pos + p->size;
+    }
+  }
+  return rv;
+}
+
+static int ad_refresh_ffmpeg(void *sf, struct adinfo *nfo) {
+  ffmpeg_audio_decoder *priv = (ffmpeg_audio_decoder*) sf;
+  if (!priv) return -1;
+  /* clear EOF condition, so that the demuxer retries reading
+   * at the current position (the file may have grown since) */
+  if (priv->formatContext->pb) {
+    priv->formatContext->pb->eof_reached = 0;
+    priv->formatContext->pb->error = 0;
+  }
+  if (priv->formatContext->duration != AV_NOPTS_VALUE) {
+    const int64_t len = priv->formatContext->duration - priv->formatContext->start_time;
+    const int64_t frames = (int64_t)(len * priv->samplerate / AV_TIME_BASE);
+    if (frames > priv->length) priv->length = frames;
+  }
+  if (priv->output_clock > priv->length) {
+    priv->length = priv->output_clock;
+  }
+  return ad_info_ffmpeg(sf, nfo);
 }
 
 static int ad_eval_ffmpeg(const char *f) { 
@@ -357,14 +1235,26 @@ static const ad_plugin ad_ffmpeg = {
   &ad_close_ffmpeg,
   &ad_info_ffmpeg,
   &ad_seek_ffmpeg,
-  &ad_read_ffmpeg
+  &ad_read_ffmpeg,
+  &ad_refresh_ffmpeg,
+  &ad_open_io_ffmpeg,
+  &ad_streams_ffmpeg,
+  &ad_read_stream_ffmpeg,
+  &ad_copy_ffmpeg,
+  &ad_byte_offset_ffmpeg
 #else
   &ad_eval_null,
   &ad_open_null,
   &ad_close_null,
   &ad_info_null,
   &ad_seek_null,
-  &ad_read_null
+  &ad_read_null,
+  &ad_refresh_null,
+  &ad_open_io_null,
+  &ad_streams_null,
+  &ad_read_stream_null,
+  &ad_copy_null,
+  &ad_byte_offset_null
 #endif
 };
 
@@ -379,6 +1269,14 @@ const ad_plugin * adp_get_ffmpeg() {
 #endif
     av_register_all();
     avcodec_register_all();
+    switch (ad_simd_level()) {
+#ifdef AD_SIMD_DISPATCH
+      case AD_SIMD_AVX512: int16_to_float = int16_to_float_avx512; break;
+      case AD_SIMD_AVX2: int16_to_float = int16_to_float_avx2; break;
+      case AD_SIMD_SSE2: int16_to_float = int16_to_float_sse2; break;
+#endif
+      default: break;
+    }
     if(ad_debug_level <= 1)
       av_log_set_level(AV_LOG_QUIET);
     else 
@@ -387,3 +1285,10 @@ const ad_plugin * adp_get_ffmpeg() {
 #endif
   return &ad_ffmpeg;
 }
+
+/* library teardown, see ad_exit() */
+void adp_exit_ffmpeg() {
+#ifdef HAVE_FFMPEG
+  codec_cache_clear();
+#endif
+}
@@ -0,0 +1,718 @@
+/**
+   Copyright (C) 2011-2018 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU Lesser Public License as published by
+   the Free Software Foundation; either version 2.1, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "audio_decoder/ad_plugin.h"
+#include "audio_decoder/ad_io.h"
+
+/* read-ahead: the file is read in blocks of RA_BLOCKSIZE bytes, aligned
+ * to the block-size. Block k is kept in slot (k % RA_NBLOCKS), so while
+ * the decoder consumes block k, blocks k+1 .. k+RA_NBLOCKS-1 are fetched.
+ */
+#define RA_BLOCKSIZE (1 << 20)
+#define RA_NBLOCKS   (4)
+#define RA_ALIGN     (4096)
+
+enum {
+	RA_FREE = 0,
+	RA_QUEUED,
+	RA_LOADING,
+	RA_READY,
+};
+
+typedef struct {
+	int64_t blk;   ///< block number
+	ssize_t len;   ///< valid bytes, -1 on read error
+	int     state;
+	uint8_t *data;
+} ra_block;
+
+typedef struct {
+	ad_io io;
+	int fd;
+	int64_t pos;
+	int64_t size;
+	ra_block b[RA_NBLOCKS];
+#ifdef HAVE_PTHREAD
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int run;
+#endif
+} ra_file;
+
+static void ra_load(ra_file *f, ra_block *b) {
+	const int64_t off = b->blk * RA_BLOCKSIZE;
+	ssize_t got = 0;
+	while (got < RA_BLOCKSIZE) {
+		ssize_t rv = pread(f->fd, b->data + got, RA_BLOCKSIZE - got, off + got);
+		if (rv < 0 && errno == EINTR) continue;
+		if (rv < 0) { got = -1; break; }
+		if (rv == 0) break;
+		got += rv;
+	}
+	b->len = got;
+}
+
+#ifdef HAVE_PTHREAD
+static void *ra_thread(void *arg) {
+	ra_file *f = (ra_file*) arg;
+	pthread_mutex_lock(&f->lock);
+	while (f->run) {
+		/* load queued blocks in file order */
+		ra_block *b = NULL;
+		int i;
+		for (i = 0; i < RA_NBLOCKS; ++i) {
+			if (f->b[i].state == RA_QUEUED && (!b || f->b[i].blk < b->blk)) {
+				b = &f->b[i];
+			}
+		}
+		if (!b) {
+			pthread_cond_wait(&f->cond, &f->lock);
+			continue;
+		}
+		b->state = RA_LOADING;
+		pthread_mutex_unlock(&f->lock);
+		ra_load(f, b);
+		pthread_mutex_lock(&f->lock);
+		b->state = RA_READY;
+		pthread_cond_broadcast(&f->cond);
+	}
+	pthread_mutex_unlock(&f->lock);
+	return NULL;
+}
+#endif
+
+/* assign block to its slot, unless it is already there.
+ * must be called with lock held. */
+static void ra_request(ra_file *f, const int64_t blk) {
+	ra_block *b = &f->b[blk % RA_NBLOCKS];
+	if (b->state != RA_FREE && b->blk == blk) {
+		return;
+	}
+#ifdef HAVE_PTHREAD
+	while (b->state == RA_LOADING) {
+		pthread_cond_wait(&f->cond, &f->lock);
+	}
+#endif
+	b->blk = blk;
+	b->len = 0;
+	b->state = RA_QUEUED;
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(f->fd, blk * RA_BLOCKSIZE, RA_BLOCKSIZE, POSIX_FADV_WILLNEED);
+#endif
+}
+
+static ssize_t ra_read(ad_io *io, void *buf, size_t len) {
+	ra_file *f = (ra_file*) io;
+	size_t written = 0;
+
+	while (written < len && f->pos < f->size) {
+		const int64_t blk = f->pos / RA_BLOCKSIZE;
+		const size_t  off = f->pos % RA_BLOCKSIZE;
+		ra_block *b = &f->b[blk % RA_NBLOCKS];
+		int retry = 1;
+		int i;
+
+again:
+#ifdef HAVE_PTHREAD
+		pthread_mutex_lock(&f->lock);
+#endif
+		ra_request(f, blk);
+		for (i = 1; i < RA_NBLOCKS; ++i) {
+			if ((blk + i) * RA_BLOCKSIZE < f->size) {
+				ra_request(f, blk + i);
+			}
+		}
+#ifdef HAVE_PTHREAD
+		pthread_cond_broadcast(&f->cond);
+		while (b->state != RA_READY) {
+			pthread_cond_wait(&f->cond, &f->lock);
+		}
+		pthread_mutex_unlock(&f->lock);
+#else
+		if (b->state != RA_READY) {
+			ra_load(f, b);
+			b->state = RA_READY;
+		}
+#endif
+		/* the slot is not re-assigned by the reader thread,
+		 * so it can be accessed without lock */
+		if (b->len < 0) {
+			/* do not keep the failed block: load it again,
+			 * report the error if that fails, too */
+#ifdef HAVE_PTHREAD
+			pthread_mutex_lock(&f->lock);
+#endif
+			b->state = RA_FREE;
+#ifdef HAVE_PTHREAD
+			pthread_mutex_unlock(&f->lock);
+#endif
+			if (retry--) {
+				goto again;
+			}
+			return written > 0 ? (ssize_t) written : -1;
+		}
+		if ((size_t) b->len <= off) {
+			break; // file was truncated
+		}
+		size_t n = b->len - off;
+		if (n > len - written) {
+			n = len - written;
+		}
+		memcpy((uint8_t*)buf + written, b->data + off, n);
+		written += n;
+		f->pos += n;
+	}
+	return written;
+}
+
+/* the file may still be written to: re-stat, blocks that were read
+ * short at the previous end-of-file are re-loaded on next access */
+static int64_t ra_length(ad_io *io) {
+	ra_file *f = (ra_file*) io;
+	struct stat st;
+	int i;
+	if (fstat(f->fd, &st) || st.st_size <= f->size) {
+		return f->size;
+	}
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&f->lock);
+#endif
+	for (i = 0; i < RA_NBLOCKS; ++i) {
+		ra_block *b = &f->b[i];
+#ifdef HAVE_PTHREAD
+		while (b->state == RA_LOADING) {
+			pthread_cond_wait(&f->cond, &f->lock);
+		}
+#endif
+		if (b->state == RA_READY && b->len < RA_BLOCKSIZE) {
+			b->state = RA_FREE;
+		}
+	}
+	f->size = st.st_size;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&f->lock);
+#endif
+	return f->size;
+}
+
+static int64_t ra_tell(ad_io *io) {
+	ra_file *f = (ra_file*) io;
+	return f->pos;
+}
+
+static int64_t ra_seek(ad_io *io, int64_t offset, int whence) {
+	ra_file *f = (ra_file*) io;
+	switch (whence) {
+		case SEEK_SET: break;
+		case SEEK_CUR: offset += f->pos; break;
+		case SEEK_END: offset += f->size; break;
+		default: return -1;
+	}
+	if (offset < 0) return -1;
+	f->pos = offset;
+	return f->pos;
+}
+
+static void ra_close(ad_io *io) {
+	ra_file *f = (ra_file*) io;
+	int i;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&f->lock);
+	f->run = 0;
+	pthread_cond_broadcast(&f->cond);
+	pthread_mutex_unlock(&f->lock);
+	pthread_join(f->thread, NULL);
+	pthread_mutex_destroy(&f->lock);
+	pthread_cond_destroy(&f->cond);
+#endif
+	for (i = 0; i < RA_NBLOCKS; ++i) {
+		free(f->b[i].data);
+	}
+	close(f->fd);
+	free(f);
+}
+
+/* set up read-ahead for a regular file, takes ownership of fd */
+static ad_io * ra_open_fd (int fd) {
+	struct stat st;
+	int i;
+	ra_file *f = (ra_file*) calloc(1, sizeof(ra_file));
+	if (!f) {
+		close(fd);
+		return NULL;
+	}
+
+	f->fd = fd;
+	if (fstat(f->fd, &st) || !S_ISREG(st.st_mode)) {
+		/* pipes and devices can not be read ahead */
+		close(f->fd);
+		free(f);
+		return NULL;
+	}
+	f->size = st.st_size;
+
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(f->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	for (i = 0; i < RA_NBLOCKS; ++i) {
+		if (posix_memalign((void**)&f->b[i].data, RA_ALIGN, RA_BLOCKSIZE)) {
+			f->b[i].data = NULL;
+			while (--i >= 0) free(f->b[i].data);
+			close(f->fd);
+			free(f);
+			return NULL;
+		}
+		f->b[i].state = RA_FREE;
+	}
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_init(&f->lock, NULL);
+	pthread_cond_init(&f->cond, NULL);
+	f->run = 1;
+	if (pthread_create(&f->thread, NULL, ra_thread, f)) {
+		pthread_mutex_destroy(&f->lock);
+		pthread_cond_destroy(&f->cond);
+		for (i = 0; i < RA_NBLOCKS; ++i) free(f->b[i].data);
+		close(f->fd);
+		free(f);
+		return NULL;
+	}
+#endif
+
+	f->io.length = ra_length;
+	f->io.seek   = ra_seek;
+	f->io.tell   = ra_tell;
+	f->io.read   = ra_read;
+	f->io.close  = ra_close;
+	dbg(2, "read-ahead %d x %d KiB", RA_NBLOCKS, RA_BLOCKSIZE / 1024);
+	return &f->io;
+}
+
+ad_io * ad_io_open_file (const char *fn) {
+	int fd = open(fn, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	return ra_open_fd(fd);
+}
+
+/* memory */
+
+typedef struct {
+	ad_io io;
+	const uint8_t *buf;
+	int64_t len;
+	int64_t pos;
+} mem_io;
+
+static ssize_t mem_read(ad_io *io, void *buf, size_t len) {
+	mem_io *m = (mem_io*) io;
+	if (m->pos >= m->len) return 0;
+	if ((int64_t) len > m->len - m->pos) {
+		len = m->len - m->pos;
+	}
+	memcpy(buf, m->buf + m->pos, len);
+	m->pos += len;
+	return len;
+}
+
+static int64_t mem_length(ad_io *io) {
+	return ((mem_io*) io)->len;
+}
+
+static int64_t mem_tell(ad_io *io) {
+	return ((mem_io*) io)->pos;
+}
+
+static int64_t mem_seek(ad_io *io, int64_t offset, int whence) {
+	mem_io *m = (mem_io*) io;
+	switch (whence) {
+		case SEEK_SET: break;
+		case SEEK_CUR: offset += m->pos; break;
+		case SEEK_END: offset += m->len; break;
+		default: return -1;
+	}
+	if (offset < 0) return -1;
+	m->pos = offset;
+	return m->pos;
+}
+
+static void mem_close(ad_io *io) {
+	free(io);
+}
+
+ad_io * ad_io_open_mem (const void *buf, size_t len) {
+	mem_io *m;
+	if (!buf) return NULL;
+	if (!(m = (mem_io*) calloc(1, sizeof(mem_io)))) return NULL;
+	m->buf = (const uint8_t*) buf;
+	m->len = len;
+	m->io.length = mem_length;
+	m->io.seek   = mem_seek;
+	m->io.tell   = mem_tell;
+	m->io.read   = mem_read;
+	m->io.close  = mem_close;
+	return &m->io;
+}
+
+/* non-seekable file-descriptor (pipe, socket, device) */
+
+/* the start of the stream is kept, so that the format can be probed
+ * more than once (see ad_open_fd) */
+#define STREAM_PREFIX (1 << 20)
+
+typedef struct {
+	ad_io io;
+	int fd;
+	int64_t pos;
+	int64_t fd_pos;   // bytes read from fd
+	uint8_t *prefix;  // the first fd_pos bytes, NULL once more than STREAM_PREFIX were read
+	size_t prefix_alloc;
+} stream_io;
+
+static void stream_record(stream_io *s, const void *buf, size_t len) {
+	if (!s->prefix) {
+		return;
+	}
+	if (s->fd_pos + len > STREAM_PREFIX) {
+		/* no more rewinding */
+		free(s->prefix);
+		s->prefix = NULL;
+		return;
+	}
+	if (s->fd_pos + len > s->prefix_alloc) {
+		size_t n = s->prefix_alloc;
+		while (n < (size_t) s->fd_pos + len) n *= 2;
+		uint8_t *p = (uint8_t*) realloc(s->prefix, n);
+		if (!p) {
+			free(s->prefix);
+			s->prefix = NULL;
+			return;
+		}
+		s->prefix = p;
+		s->prefix_alloc = n;
+	}
+	memcpy(s->prefix + s->fd_pos, buf, len);
+}
+
+static ssize_t stream_read(ad_io *io, void *buf, size_t len) {
+	stream_io *s = (stream_io*) io;
+	size_t got = 0;
+	if (s->pos < s->fd_pos) {
+		/* after a seek back, replay the prefix */
+		got = s->fd_pos - s->pos < (int64_t) len ? s->fd_pos - s->pos : len;
+		memcpy(buf, s->prefix + s->pos, got);
+		s->pos += got;
+	}
+	while (got < len) {
+		ssize_t rv = read(s->fd, (uint8_t*)buf + got, len - got);
+		if (rv < 0 && errno == EINTR) continue;
+		if (rv < 0) return got > 0 ? (ssize_t) got : -1;
+		if (rv == 0) break;
+		stream_record(s, (uint8_t*)buf + got, rv);
+		s->fd_pos += rv;
+		s->pos += rv;
+		got += rv;
+	}
+	return got;
+}
+
+static int64_t stream_length(ad_io *io) {
+	return -1;
+}
+
+static int64_t stream_tell(ad_io *io) {
+	return ((stream_io*) io)->pos;
+}
+
+static int64_t stream_seek(ad_io *io, int64_t offset, int whence) {
+	stream_io *s = (stream_io*) io;
+	uint8_t tmp[4096];
+	switch (whence) {
+		case SEEK_SET: break;
+		case SEEK_CUR: offset += s->pos; break;
+		default: return -1;
+	}
+	if (offset < 0) {
+		return -1;
+	}
+	/* backwards only within the prefix */
+	if (offset < s->fd_pos) {
+		if (!s->prefix) return -1;
+		s->pos = offset;
+		return s->pos;
+	}
+	/* forward seeks skip data */
+	while (offset > s->pos) {
+		size_t n = offset - s->pos > (int64_t) sizeof(tmp) ? sizeof(tmp) : offset - s->pos;
+		if (stream_read(io, tmp, n) <= 0) break;
+	}
+	return offset == s->pos ? s->pos : -1;
+}
+
+static void stream_close(ad_io *io) {
+	stream_io *s = (stream_io*) io;
+	close(s->fd);
+	free(s->prefix);
+	free(s);
+}
+
+ad_io * ad_io_open_fd (int fd) {
+	struct stat st;
+	stream_io *s;
+	int dfd = dup(fd);
+	if (dfd < 0) {
+		return NULL;
+	}
+	if (fstat(dfd, &st) == 0 && S_ISREG(st.st_mode)) {
+		return ra_open_fd(dfd);
+	}
+	if (!(s = (stream_io*) calloc(1, sizeof(stream_io)))) {
+		close(dfd);
+		return NULL;
+	}
+	s->prefix_alloc = 65536;
+	if (!(s->prefix = (uint8_t*) malloc(s->prefix_alloc))) {
+		close(dfd);
+		free(s);
+		return NULL;
+	}
+	s->fd = dfd;
+	s->io.length = stream_length;
+	s->io.seek   = stream_seek;
+	s->io.tell   = stream_tell;
+	s->io.read   = stream_read;
+	s->io.close  = stream_close;
+	return &s->io;
+}
+
+/* block cache for remote resources */
+
+#define RC_BLOCKSIZE (1 << 18)
+
+/* default cache size: 1/16 of the resource, 1 MiB .. 32 MiB */
+#define RC_FRACTION  (16)
+#define RC_MINBLOCKS (4)
+#define RC_MAXBLOCKS (128)
+
+typedef struct {
+	int64_t blk;   ///< block number, -1: unused
+	ssize_t len;   ///< valid bytes
+	uint64_t used; ///< last access, see rc_cache.clock
+	uint8_t *data;
+} rc_block;
+
+typedef struct {
+	ad_io io;
+	void *arg;
+	ad_io_fetch fetch;
+	void (*release)(void *);
+	int64_t pos;
+	int64_t size;
+	uint64_t clock;
+	/* statistics */
+	int64_t n_fetch;
+	int64_t n_bytes;
+	int n_blocks;
+	rc_block b[]; ///< n_blocks
+} rc_cache;
+
+static rc_block * rc_lookup(rc_cache *c, const int64_t blk) {
+	rc_block *lru = &c->b[0];
+	int i;
+	for (i = 0; i < c->n_blocks; ++i) {
+		if (c->b[i].blk == blk) {
+			c->b[i].used = ++c->clock;
+			return &c->b[i];
+		}
+		if (c->b[i].used < lru->used) {
+			lru = &c->b[i];
+		}
+	}
+
+	/* miss, replace the least recently used block */
+	if (!lru->data && !(lru->data = (uint8_t*) malloc(RC_BLOCKSIZE))) {
+		return NULL;
+	}
+	const int64_t off = blk * RC_BLOCKSIZE;
+	const size_t len = c->size - off < RC_BLOCKSIZE ? c->size - off : RC_BLOCKSIZE;
+	lru->blk = -1;
+	lru->len = c->fetch(c->arg, off, lru->data, len);
+	if (lru->len >= 0 && (size_t) lru->len < len) {
+		/* short read (e.g. a dropped connection), try once for the rest */
+		dbg(1, "cache: short read at %"PRIi64", retrying", off + lru->len);
+		const ssize_t rv = c->fetch(c->arg, off + lru->len, lru->data + lru->len, len - lru->len);
+		lru->len = rv < 0 ? -1 : lru->len + rv;
+	}
+	if (lru->len < 0 || (size_t) lru->len < len) {
+		/* a partial block is not cached */
+		dbg(0, "cache: cannot read %ld bytes at offset %"PRIi64, (long) len, off);
+		return NULL;
+	}
+	lru->blk = blk;
+	lru->used = ++c->clock;
+	c->n_fetch++;
+	c->n_bytes += lru->len;
+	dbg(3, "cache: fetched %"PRIi64" + %ld", off, (long) lru->len);
+	return lru;
+}
+
+static ssize_t rc_read(ad_io *io, void *buf, size_t len) {
+	rc_cache *c = (rc_cache*) io;
+	size_t written = 0;
+
+	while (written < len && c->pos < c->size) {
+		const int64_t blk = c->pos / RC_BLOCKSIZE;
+		const size_t  off = c->pos % RC_BLOCKSIZE;
+		rc_block *b = rc_lookup(c, blk);
+		if (!b) {
+			return written > 0 ? (ssize_t) written : -1;
+		}
+		size_t n = b->len - off;
+		if (n > len - written) {
+			n = len - written;
+		}
+		memcpy((uint8_t*)buf + written, b->data + off, n);
+		written += n;
+		c->pos += n;
+	}
+	return written;
+}
+
+static int64_t rc_length(ad_io *io) {
+	return ((rc_cache*) io)->size;
+}
+
+static int64_t rc_tell(ad_io *io) {
+	return ((rc_cache*) io)->pos;
+}
+
+static int64_t rc_seek(ad_io *io, int64_t offset, int whence) {
+	rc_cache *c = (rc_cache*) io;
+	switch (whence) {
+		case SEEK_SET: break;
+		case SEEK_CUR: offset += c->pos; break;
+		case SEEK_END: offset += c->size; break;
+		default: return -1;
+	}
+	if (offset < 0) return -1;
+	c->pos = offset;
+	return c->pos;
+}
+
+static void rc_close(ad_io *io) {
+	rc_cache *c = (rc_cache*) io;
+	int i;
+	dbg(1, "cache: %"PRIi64" requests, %"PRIi64" of %"PRIi64" bytes transferred",
+			c->n_fetch, c->n_bytes, c->size);
+	for (i = 0; i < c->n_blocks; ++i) {
+		free(c->b[i].data);
+	}
+	if (c->release) {
+		c->release(c->arg);
+	}
+	free(c);
+}
+
+ad_io * ad_io_open_cache (void *arg, ad_io_fetch fetch, void (*release)(void *arg), int64_t length, size_t cache_size) {
+	rc_cache *c;
+	int64_t n;
+	int i;
+	if (!fetch || length < 0) return NULL;
+
+	if (cache_size > 0) {
+		n = (cache_size + RC_BLOCKSIZE - 1) / RC_BLOCKSIZE;
+	} else {
+		n = length / ((int64_t) RC_FRACTION * RC_BLOCKSIZE);
+		if (n > RC_MAXBLOCKS) n = RC_MAXBLOCKS;
+	}
+	/* the head and the tail of the file, and a block in between */
+	if (n < RC_MINBLOCKS) n = RC_MINBLOCKS;
+	/* no more than the resource */
+	if (n > (length + RC_BLOCKSIZE - 1) / RC_BLOCKSIZE) n = (length + RC_BLOCKSIZE - 1) / RC_BLOCKSIZE;
+	if (n < 1) n = 1;
+	if (n > INT_MAX / 2) n = INT_MAX / 2;
+
+	if (!(c = (rc_cache*) calloc(1, sizeof(rc_cache) + n * sizeof(rc_block)))) return NULL;
+	c->n_blocks = n;
+	c->arg = arg;
+	c->fetch = fetch;
+	c->release = release;
+	c->size = length;
+	for (i = 0; i < c->n_blocks; ++i) {
+		c->b[i].blk = -1;
+	}
+	c->io.length = rc_length;
+	c->io.seek   = rc_seek;
+	c->io.tell   = rc_tell;
+	c->io.read   = rc_read;
+	c->io.close  = rc_close;
+	dbg(2, "cache %d x %d KiB", c->n_blocks, RC_BLOCKSIZE / 1024);
+	return &c->io;
+}
+
+/* copy a byte range between files */
+
+int ad_io_copy_range (int fd_in, int64_t offset, int fd_out, int64_t len) {
+	char buf[65536];
+	off_t off = offset;
+	ssize_t n;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	/* in-kernel, may share extents on reflink capable file-systems */
+	while (len > 0 && (n = copy_file_range(fd_in, &off, fd_out, NULL, len, 0)) > 0) {
+		len -= n;
+	}
+	if (len == 0) return 0;
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+	while (len > 0 && (n = sendfile(fd_out, fd_in, &off, len > (1 << 30) ? (1 << 30) : len)) > 0) {
+		len -= n;
+	}
+	if (len == 0) return 0;
+#endif
+	while (len > 0) {
+		n = pread(fd_in, buf, len > (int64_t) sizeof(buf) ? sizeof(buf) : len, off);
+		if (n <= 0 || write(fd_out, buf, n) != n) {
+			return -1;
+		}
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
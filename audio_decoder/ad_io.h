@@ -0,0 +1,115 @@
+/**
+   @brief audio-decoder - byte-stream input abstraction
+   @file ad_io.h
+   @author Robin Gareus <robin@gareus.org>
+
+   Copyright (C) 2011-2018 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU Lesser Public License as published by
+   the Free Software Foundation; either version 2.1, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#ifndef __AD_IO_H__
+#define __AD_IO_H__
+
+#include <stdint.h>
+#include <unistd.h>
+
+/** byte-stream the decoder back-ends read from
+ * (libsndfile SF_VIRTUAL_IO, ffmpeg AVIOContext).
+ * seek() follows lseek() semantics, length() is -1 if unknown.
+ * For files, length() is re-read: the file may grow while it is read.
+ */
+typedef struct ad_io ad_io;
+
+struct ad_io {
+	int64_t (*length)(ad_io *);
+	int64_t (*seek)(ad_io *, int64_t offset, int whence);
+	int64_t (*tell)(ad_io *);
+	ssize_t (*read)(ad_io *, void *buf, size_t len);
+	void    (*close)(ad_io *);
+};
+
+/** open a file for sequential reading.
+ *
+ * Data is read in large aligned blocks, ahead of the current position
+ * by a background thread (if available), hinting the kernel about the
+ * access pattern. This hides storage latency (network file-systems,
+ * FUSE mounts) from the decoder.
+ *
+ * @param fn file-name
+ * @return NULL on error
+ */
+ad_io * ad_io_open_file (const char *fn);
+
+/** read from a memory buffer.
+ * the buffer is not copied and must remain valid until the stream is closed.
+ */
+ad_io * ad_io_open_mem (const void *buf, size_t len);
+
+/** read from an open file-descriptor.
+ *
+ * The descriptor is duplicated, the caller remains responsible for closing fd.
+ * Regular files are read from the beginning (with read-ahead), independent
+ * of the current file-offset. Pipes and sockets are read sequentially,
+ * they have an unknown length (-1) and allow forward seeks. Seeking back
+ * is possible until more than the first MiB of data has been read, so
+ * that more than one decoder can probe the format.
+ */
+ad_io * ad_io_open_fd (int fd);
+
+/** fetch a range of bytes from a remote resource
+ * @return number of bytes read, -1 on error. A short read is retried once
+ *  for the remainder, if that is still short the read fails.
+ */
+typedef ssize_t (*ad_io_fetch) (void *arg, int64_t offset, void *buf, size_t len);
+
+/** read a remote resource through a local block cache.
+ *
+ * Data is fetched in large aligned blocks, each with a single ranged
+ * request, and kept (least recently used) in memory. The decoder's seeks
+ * only move the position: reading back and forth near the head or tail
+ * of the file is served from the cache, consecutive blocks are fetched
+ * sequentially.
+ *
+ * @param arg passed to fetch and release
+ * @param fetch read a byte-range of the resource
+ * @param release called on close, may be NULL
+ * @param length size of the resource in bytes
+ * @param cache_size memory for cached data in bytes (rounded up to blocks of
+ *  256 KiB, at least 1 MiB), 0: 1/16 of the resource, at most 32 MiB.
+ *  The cache is never larger than the resource.
+ * @return NULL on error
+ */
+ad_io * ad_io_open_cache (void *arg, ad_io_fetch fetch, void (*release)(void *arg), int64_t length, size_t cache_size);
+
+/** copy a range of bytes from one file to another, without conversion.
+ *
+ * Uses copy_file_range() or sendfile() where available, the data does not
+ * pass through user-space. Data is written at the current position of fd_out.
+ *
+ * @param fd_in file to read from, its file-offset is not modified
+ * @param offset byte-offset in fd_in
+ * @param len number of bytes to copy
+ * @return 0 on success, -1 on error
+ */
+int ad_io_copy_range (int fd_in, int64_t offset, int fd_out, int64_t len);
+
+static inline int64_t ad_io_length (ad_io *io) { return io->length(io); }
+static inline int64_t ad_io_seek (ad_io *io, int64_t off, int whence) { return io->seek(io, off, whence); }
+static inline int64_t ad_io_tell (ad_io *io) { return io->tell(io); }
+static inline ssize_t ad_io_read (ad_io *io, void *buf, size_t len) { return io->read(io, buf, len); }
+static inline void    ad_io_close (ad_io *io) { if (io) io->close(io); }
+
+#endif
@@ -21,10 +21,13 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <math.h>
 
 #include "audio_decoder/ad_plugin.h"
+#include "audio_decoder/ad_simd.h"
+#include "audio_decoder/ad_pool.h"
 
 int ad_debug_level = 0;
 
@@ -36,6 +39,12 @@ int     ad_close_null(void *x) { UNUSED(x); return -1; }
 int     ad_info_null(void *x, struct adinfo *n) { UNUSED(x); UNUSED(n); return -1; }
 int64_t ad_seek_null(void *x, int64_t p) { UNUSED(x); UNUSED(p); return -1; }
 ssize_t ad_read_null(void *x, float*d, size_t s) { UNUSED(x); UNUSED(d); UNUSED(s); return -1;}
+int     ad_refresh_null(void *x, struct adinfo *n) { UNUSED(x); UNUSED(n); return -1; }
+void *  ad_open_io_null(ad_io *x, struct adinfo *n) { UNUSED(x); UNUSED(n); return NULL; }
+int     ad_streams_null(void *x, struct adinfo *n, int *i, int m) { UNUSED(x); UNUSED(n); UNUSED(i); UNUSED(m); return -1; }
+ssize_t ad_read_stream_null(void *x, float*d, size_t s, int *i) { UNUSED(x); UNUSED(d); UNUSED(s); UNUSED(i); return -1; }
+int     ad_copy_null(void *x, const char * const *f, int64_t const *s, int64_t const *e, int n) { UNUSED(x); UNUSED(f); UNUSED(s); UNUSED(e); UNUSED(n); return -1; }
+int64_t ad_byte_offset_null(void *x, int64_t p) { UNUSED(x); UNUSED(p); return -1; }
 
 typedef struct {
 	ad_plugin const *b; ///< decoder back-end
@@ -46,6 +55,10 @@ typedef struct {
 
 void ad_init() { /* global init */ }
 
+void ad_exit() {
+	adp_exit_ffmpeg();
+}
+
 static ad_plugin const * choose_backend(const char *fn) {
 	int max, val;
 	ad_plugin const *b=NULL;
@@ -61,23 +74,67 @@ static ad_plugin const * choose_backend(const char *fn) {
 }
 
 void *ad_open(const char *fn, struct adinfo *nfo) {
-	adecoder *d = (adecoder*) calloc(1, sizeof(adecoder));
+	adecoder *d = (adecoder*) ad_pool_calloc(1, sizeof(adecoder));
 	ad_clear_nfo(nfo);
+	if (!d) return NULL;
 
 	d->b = choose_backend(fn);
 	if (!d->b) {
 		dbg(0, "fatal: no decoder backend available");
-		free(d);
+		ad_pool_free(d);
 		return NULL;
 	}
 	d->d = d->b->open(fn, nfo);
 	if (!d->d) {
-		free(d);
+		ad_pool_free(d);
 		return NULL;
 	}
 	return (void*)d;
 }
 
+/* open from a byte-stream, there is no file-name to guess the format
+ * from: let libsndfile probe the header first, then try ffmpeg.
+ * takes ownership of io. */
+static void *ad_open_io(ad_io *io, struct adinfo *nfo) {
+	ad_plugin const *backends[2];
+	adecoder *d;
+	int i;
+
+	if (!io) return NULL;
+	backends[0] = adp_get_sndfile();
+	backends[1] = adp_get_ffmpeg();
+
+	d = (adecoder*) ad_pool_calloc(1, sizeof(adecoder));
+	ad_clear_nfo(nfo);
+	if (!d) {
+		ad_io_close(io);
+		return NULL;
+	}
+
+	for (i = 0; i < 2; ++i) {
+		if (ad_io_seek(io, 0, SEEK_SET) != 0) {
+			/* non-seekable stream that has already been read from */
+			break;
+		}
+		if ((d->d = backends[i]->open_io(io, nfo))) {
+			d->b = backends[i];
+			return (void*)d;
+		}
+	}
+	dbg(0, "no decoder backend can read the stream");
+	ad_io_close(io);
+	ad_pool_free(d);
+	return NULL;
+}
+
+void *ad_open_mem(const void *buf, size_t len, struct adinfo *nfo) {
+	return ad_open_io(ad_io_open_mem(buf, len), nfo);
+}
+
+void *ad_open_fd(int fd, struct adinfo *nfo) {
+	return ad_open_io(ad_io_open_fd(fd), nfo);
+}
+
 int ad_info(void *sf, struct adinfo *nfo) {
 	adecoder *d = (adecoder*) sf;
 	if (!d) return -1;
@@ -88,7 +145,7 @@ int ad_close(void *sf) {
 	adecoder *d = (adecoder*) sf;
 	if (!d) return -1;
 	int rv = d->b->close(d->d);
-	free(d);
+	ad_pool_free(d);
 	return rv;
 }
 
@@ -104,11 +161,103 @@ ssize_t ad_read(void *sf, float* out, size_t len){
 	return d->b->read(d->d, out, len);
 }
 
+int ad_refresh(void *sf, struct adinfo *nfo) {
+	adecoder *d = (adecoder*) sf;
+	if (!d) return -1;
+	return d->b->refresh(d->d, nfo);
+}
+
+int ad_streams(void *sf, struct adinfo *nfo, int *index, int max) {
+	adecoder *d = (adecoder*) sf;
+	if (!d) return -1;
+	return d->b->streams(d->d, nfo, index, max);
+}
+
+ssize_t ad_read_stream(void *sf, float* out, size_t len, int *stream) {
+	adecoder *d = (adecoder*) sf;
+	if (!d) return -1;
+	return d->b->read_stream(d->d, out, len, stream);
+}
+
+int ad_copy(void *sf, const char *fn, int64_t start, int64_t end) {
+	return ad_copy_ranges(sf, &fn, &start, &end, 1);
+}
+
+int ad_copy_ranges(void *sf, const char * const *fn, int64_t const *start, int64_t const *end, int n) {
+	adecoder *d = (adecoder*) sf;
+	int i;
+	if (!d || !fn || n < 1) return -1;
+	for (i = 0; i < n; ++i) {
+		if (!fn[i] || start[i] < 0 || end[i] < start[i] || (i > 0 && start[i] < end[i - 1])) return -1;
+	}
+	return d->b->copy(d->d, fn, start, end, n);
+}
+
+int64_t ad_byte_offset(void *sf, int64_t frame) {
+	adecoder *d = (adecoder*) sf;
+	if (!d || frame < 0) return -1;
+	return d->b->byte_offset(d->d, frame);
+}
+
+int ad_simd_level(void) {
+	static int level = -1;
+	if (level >= 0) return level;
+
+	int lvl = AD_SIMD_NONE;
+#ifdef AD_SIMD_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) lvl = AD_SIMD_SSE2;
+	if (__builtin_cpu_supports("avx2")) lvl = AD_SIMD_AVX2;
+	if (__builtin_cpu_supports("avx512f")) lvl = AD_SIMD_AVX512;
+#endif
+
+	const char *cap = getenv("AD_SIMD");
+	if (cap) {
+		int i;
+		for (i = AD_SIMD_NONE; i <= AD_SIMD_AVX512; ++i) {
+			if (!strcasecmp(cap, ad_simd_name(i)) && i < lvl) {
+				lvl = i;
+			}
+		}
+	}
+	dbg(1, "using %s kernels", ad_simd_name(lvl));
+	level = lvl;
+	return level;
+}
+
+const char *ad_simd_name(int level) {
+	switch (level) {
+		case AD_SIMD_SSE2: return "sse2";
+		case AD_SIMD_AVX2: return "avx2";
+		case AD_SIMD_AVX512: return "avx512";
+		default: break;
+	}
+	return "none";
+}
+
+#define DOWNMIX(NAME, ATTR) \
+static ATTR void NAME(float const * const buf, double * const d, const unsigned int n_frames, const unsigned int chn) { \
+	unsigned int c,f; \
+	for (f=0;f<n_frames;f++) { \
+		double val=0.0; \
+		for (c=0;c<chn;c++) { \
+			val+=buf[f*chn + c]; \
+		} \
+		d[f]= val/chn; \
+	} \
+}
+
+DOWNMIX(downmix_dbl, )
+#ifdef AD_SIMD_DISPATCH
+DOWNMIX(downmix_dbl_sse2, AD_TARGET_SSE2)
+DOWNMIX(downmix_dbl_avx2, AD_TARGET_AVX2)
+DOWNMIX(downmix_dbl_avx512, AD_TARGET_AVX512)
+#endif
+
 /*
  *  side-effects: allocates buffer
  */
 ssize_t ad_read_mono_dbl(void *sf, struct adinfo *nfo, double* d, size_t len){
-	unsigned int c,f;
 	unsigned int chn = nfo->channels;
 	if (len<1) return 0;
 
@@ -121,12 +270,13 @@ ssize_t ad_read_mono_dbl(void *sf, struct adinfo *nfo, double* d, size_t len){
 
 	len = ad_read(sf, buf, bufsiz);
 
-	for (f=0;f< (len/chn);f++) {
-		double val=0.0;
-		for (c=0;c<chn;c++) {
-			val+=buf[f*chn + c];
-		}
-		d[f]= val/chn;
+	switch (ad_simd_level()) {
+#ifdef AD_SIMD_DISPATCH
+		case AD_SIMD_AVX512: downmix_dbl_avx512(buf, d, len/chn, chn); break;
+		case AD_SIMD_AVX2: downmix_dbl_avx2(buf, d, len/chn, chn); break;
+		case AD_SIMD_SSE2: downmix_dbl_sse2(buf, d, len/chn, chn); break;
+#endif
+		default: downmix_dbl(buf, d, len/chn, chn); break;
 	}
 	return len/chn;
 }
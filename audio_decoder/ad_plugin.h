@@ -20,6 +20,7 @@
 #define __AD_PLUGIN_H__
 #include <stdint.h>
 #include "audio_decoder/ad.h"
+#include "audio_decoder/ad_io.h"
 
 #define dbg(A, B, ...) ad_debug_printf(__func__, A, B, ##__VA_ARGS__)
 
@@ -49,6 +50,12 @@ typedef struct {
 	int     (*info)(void *, struct adinfo *);
 	int64_t (*seek)(void *, int64_t);
 	ssize_t (*read)(void *, float *, size_t);
+	int     (*refresh)(void *, struct adinfo *);
+	void *  (*open_io)(ad_io *, struct adinfo *);
+	int     (*streams)(void *, struct adinfo *, int *, int);
+	ssize_t (*read_stream)(void *, float *, size_t, int *);
+	int     (*copy)(void *, const char * const *, int64_t const *, int64_t const *, int);
+	int64_t (*byte_offset)(void *, int64_t);
 } ad_plugin;
 
 int     ad_eval_null(const char *);
@@ -57,8 +64,17 @@ int     ad_close_null(void *);
 int     ad_info_null(void *, struct adinfo *);
 int64_t ad_seek_null(void *, int64_t);
 ssize_t ad_read_null(void *, float*, size_t);
+int     ad_refresh_null(void *, struct adinfo *);
+void *  ad_open_io_null(ad_io *, struct adinfo *);
+int     ad_streams_null(void *, struct adinfo *, int *, int);
+ssize_t ad_read_stream_null(void *, float *, size_t, int *);
+int     ad_copy_null(void *, const char * const *, int64_t const *, int64_t const *, int);
+int64_t ad_byte_offset_null(void *, int64_t);
 
 /* hardcoded backends */
 const ad_plugin * adp_get_sndfile();
 const ad_plugin * adp_get_ffmpeg();
+
+/* release state kept across files, see ad_exit() */
+void adp_exit_ffmpeg();
 #endif
@@ -0,0 +1,152 @@
+/**
+   Copyright (C) 2011-2018 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU Lesser Public License as published by
+   the Free Software Foundation; either version 2.1, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "audio_decoder/ad_pool.h"
+
+/* size classes: four per power of two (2^k, 1.25, 1.5, 1.75 * 2^k bytes,
+ * incl. header), from 64 bytes up to 1 MiB. Rounding wastes less than 25%.
+ * Larger blocks are allocated and freed directly, with their exact size */
+#define POOL_MIN_SHIFT (6)
+#define POOL_MAX_SHIFT (20)
+#define POOL_CLASSES   (4 * (POOL_MAX_SHIFT - POOL_MIN_SHIFT) + 1)
+/* max number of idle blocks kept per class */
+#define POOL_MAX_IDLE  (16)
+/* max total size of idle blocks, the rest is returned to the system */
+#define POOL_MAX_CACHED (8 << 20)
+
+typedef union pool_block {
+	struct {
+		union pool_block *next; // free-list
+		size_t cls;             // size class, POOL_CLASSES: direct
+		size_t size;            // total size, incl. header
+	} h;
+	char align[32];
+} pool_block;
+
+static struct {
+	pool_block *free[POOL_CLASSES];
+	unsigned int idle[POOL_CLASSES];
+	size_t in_use;
+	size_t cached;
+} pool;
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+# define POOL_LOCK pthread_mutex_lock(&pool_lock)
+# define POOL_UNLOCK pthread_mutex_unlock(&pool_lock)
+#else
+# define POOL_LOCK
+# define POOL_UNLOCK
+#endif
+
+static size_t class_size(size_t cls) {
+	return (size_t)(4 + (cls & 3)) << ((cls >> 2) + POOL_MIN_SHIFT - 2);
+}
+
+/* smallest class that holds size bytes, POOL_CLASSES if none */
+static size_t size_class(size_t size) {
+	size_t k = POOL_MIN_SHIFT;
+	if (size <= ((size_t)1 << POOL_MIN_SHIFT)) {
+		return 0;
+	}
+	if (size > ((size_t)1 << POOL_MAX_SHIFT)) {
+		return POOL_CLASSES;
+	}
+	/* 2^k < size <= 2^(k+1) */
+	while (((size_t)1 << (k + 1)) < size) {
+		++k;
+	}
+	const size_t step = (size_t)1 << (k - 2);
+	return 4 * (k - POOL_MIN_SHIFT) + (size - ((size_t)1 << k) + step - 1) / step;
+}
+
+void *ad_pool_alloc(size_t size) {
+	pool_block *b = NULL;
+	if (size > SIZE_MAX - sizeof(pool_block)) return NULL;
+	size += sizeof(pool_block);
+
+	const size_t cls = size_class(size);
+	if (cls < POOL_CLASSES) {
+		size = class_size(cls);
+		POOL_LOCK;
+		if ((b = pool.free[cls])) {
+			pool.free[cls] = b->h.next;
+			pool.idle[cls]--;
+			pool.cached -= size;
+		}
+		pool.in_use += size;
+		POOL_UNLOCK;
+	} else {
+		POOL_LOCK;
+		pool.in_use += size;
+		POOL_UNLOCK;
+	}
+
+	if (!b && !(b = (pool_block*) malloc(size))) {
+		POOL_LOCK;
+		pool.in_use -= size;
+		POOL_UNLOCK;
+		return NULL;
+	}
+	b->h.next = NULL;
+	b->h.cls = cls;
+	b->h.size = size;
+	return b + 1;
+}
+
+void *ad_pool_calloc(size_t n, size_t size) {
+	if (size && n > SIZE_MAX / size) return NULL;
+	void *p = ad_pool_alloc(n * size);
+	if (p) memset(p, 0, n * size);
+	return p;
+}
+
+void ad_pool_free(void *ptr) {
+	if (!ptr) return;
+	pool_block *b = ((pool_block*) ptr) - 1;
+	const size_t cls = b->h.cls;
+
+	POOL_LOCK;
+	pool.in_use -= b->h.size;
+	if (cls < POOL_CLASSES && pool.idle[cls] < POOL_MAX_IDLE
+			&& pool.cached + b->h.size <= POOL_MAX_CACHED) {
+		b->h.next = pool.free[cls];
+		pool.free[cls] = b;
+		pool.idle[cls]++;
+		pool.cached += b->h.size;
+		b = NULL;
+	}
+	POOL_UNLOCK;
+	free(b);
+}
+
+void ad_pool_stats(size_t *in_use, size_t *cached) {
+	POOL_LOCK;
+	if (in_use) *in_use = pool.in_use;
+	if (cached) *cached = pool.cached;
+	POOL_UNLOCK;
+}
@@ -0,0 +1,52 @@
+/**
+   @brief audio-decoder - pooled allocator for decoder and analysis state
+   @file ad_pool.h
+   @author Robin Gareus <robin@gareus.org>
+
+   Copyright (C) 2011-2018 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU Lesser Public License as published by
+   the Free Software Foundation; either version 2.1, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#ifndef __AD_POOL_H__
+#define __AD_POOL_H__
+
+#include <stddef.h>
+
+/* Blocks are grouped in size classes, four per power of two. Freed blocks are kept
+ * on a per-class free-list (up to a limit per class and in total) and handed
+ * out again, so that opening and closing many decoders does not fragment the
+ * heap. Blocks larger than 1 MiB are not pooled.
+ * All functions are thread-safe.
+ */
+
+/** allocate a block of at least size bytes, 16 byte aligned.
+ * @return NULL on error
+ */
+void * ad_pool_alloc  (size_t size);
+
+/** allocate a zero-initialized block of n * size bytes */
+void * ad_pool_calloc (size_t n, size_t size);
+
+/** return a block to the pool, ptr may be NULL */
+void   ad_pool_free   (void *ptr);
+
+/** memory statistics
+ * @param in_use bytes currently handed out (including class rounding)
+ * @param cached bytes kept on free-lists for reuse
+ */
+void   ad_pool_stats  (size_t *in_use, size_t *cached);
+
+#endif
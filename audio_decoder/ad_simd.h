@@ -0,0 +1,66 @@
+/**
+   @brief audio-decoder - runtime CPU feature dispatch
+   @file ad_simd.h
+   @author Robin Gareus <robin@gareus.org>
+
+   Copyright (C) 2011-2018 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU Lesser Public License as published by
+   the Free Software Foundation; either version 2.1, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#ifndef __AD_SIMD_H__
+#define __AD_SIMD_H__
+
+/* Flat sample loops that the compiler vectorizes (sample-format
+ * conversion, downmix) are compiled several times with different target
+ * attributes and the best variant for the CPU at hand is picked at
+ * runtime. This allows a binary built for a generic target (e.g. the
+ * static builds) to use AVX2/AVX-512 where available.
+ *
+ * The silence detector is not dispatched: its filter and running sum
+ * are serial, wider vectors do not help there.
+ *
+ * Variants must not change results: none of the targets enables FMA,
+ * so rounding is identical to the generic code.
+ */
+
+#if (defined __x86_64__ || defined __i386__) \
+	&& (defined __clang__ || (defined __GNUC__ && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+# define AD_SIMD_DISPATCH
+# define AD_TARGET_SSE2   __attribute__((target("sse2")))
+# define AD_TARGET_AVX2   __attribute__((target("avx2")))
+# define AD_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+enum {
+	AD_SIMD_NONE = 0,
+	AD_SIMD_SSE2,
+	AD_SIMD_AVX2,
+	AD_SIMD_AVX512
+};
+
+/** query the best supported instruction set.
+ *
+ * The result can be capped by setting the environment variable
+ * AD_SIMD to one of "none", "sse2", "avx2" or "avx512".
+ *
+ * @return one of AD_SIMD_NONE, AD_SIMD_SSE2, AD_SIMD_AVX2, AD_SIMD_AVX512
+ */
+int ad_simd_level(void);
+
+/** name of the given simd level, for debug output */
+const char *ad_simd_name(int level);
+
+#endif
@@ -22,18 +22,70 @@
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <math.h>
 #include <sndfile.h>
 
 #include "audio_decoder/ad_plugin.h"
+#include "audio_decoder/ad_io.h"
+#include "audio_decoder/ad_pool.h"
 
 /* internal abstraction */
 
 typedef struct {
 	SF_INFO sfinfo;
 	SNDFILE *sffile;
+	ad_io *io;
+	char *fn;
+	int64_t data_pos;     // byte-offset of the PCM data, -1: unknown
+	uint32_t block_align; // bytes per frame
 } sndfile_audio_decoder;
 
+/* libsndfile virtual I/O on top of ad_io */
+
+static sf_count_t vio_get_filelen(void *user_data) {
+	return ad_io_length((ad_io*) user_data);
+}
+
+static sf_count_t vio_seek(sf_count_t offset, int whence, void *user_data) {
+	return ad_io_seek((ad_io*) user_data, offset, whence);
+}
+
+static sf_count_t vio_read(void *ptr, sf_count_t count, void *user_data) {
+	ssize_t rv = ad_io_read((ad_io*) user_data, ptr, count);
+	return rv < 0 ? 0 : rv;
+}
+
+static sf_count_t vio_write(const void *ptr, sf_count_t count, void *user_data) {
+	return 0;
+}
+
+static sf_count_t vio_tell(void *user_data) {
+	return ad_io_tell((ad_io*) user_data);
+}
+
+static SF_VIRTUAL_IO ad_sf_vio = {
+	&vio_get_filelen,
+	&vio_seek,
+	&vio_read,
+	&vio_write,
+	&vio_tell
+};
+
+/** open file with read-ahead I/O, falling back to plain sf_open() */
+static SNDFILE *sf_open_readahead(const char *fn, SF_INFO *sfinfo, ad_io **io) {
+	SNDFILE *sffile;
+	*io = ad_io_open_file(fn);
+	if (*io) {
+		if ((sffile = sf_open_virtual(&ad_sf_vio, SFM_READ, sfinfo, *io))) {
+			return sffile;
+		}
+		ad_io_close(*io);
+		*io = NULL;
+	}
+	return sf_open(fn, SFM_READ, sfinfo);
+}
+
 static int parse_bit_depth(int format) {
 	/* see http://www.mega-nerd.com/libsndfile/api.html */
 	switch (format&0x0f) {
@@ -49,6 +101,65 @@ static int parse_bit_depth(int format) {
 	return 0;
 }
 
+static uint32_t rd_le32(const unsigned char *b) {
+	return b[0] | b[1] << 8 | b[2] << 16 | (uint32_t) b[3] << 24;
+}
+
+static void wr_le32(unsigned char *b, uint32_t v) {
+	b[0] = v; b[1] = v >> 8; b[2] = v >> 16; b[3] = v >> 24;
+}
+
+struct wav_layout {
+	int64_t data_pos;     // offset of the "data" chunk header
+	int64_t fact_pos;     // offset of the "fact" sample-count, -1: none
+	int64_t frames;       // frames available in the data chunk
+	uint32_t block_align; // bytes per frame
+};
+
+/** locate the sample data of a RIFF/WAVE file with fixed size frames.
+ * @return 0 on success, -1 if this is not such a file
+ */
+static int wav_parse(const int fd, struct wav_layout *w) {
+	unsigned char c[16];
+	int64_t pos;
+	uint32_t data_len = 0;
+
+	w->data_pos = w->fact_pos = -1;
+	w->block_align = 0;
+
+	const int64_t flen = lseek(fd, 0, SEEK_END);
+	if (pread(fd, c, 12, 0) != 12 || memcmp(c, "RIFF", 4) || memcmp(c + 8, "WAVE", 4)) {
+		return -1;
+	}
+	for (pos = 12; pos + 8 <= flen; ) {
+		if (pread(fd, c, 8, pos) != 8) return -1;
+		const uint32_t len = rd_le32(c + 4);
+		if (!memcmp(c, "data", 4)) {
+			w->data_pos = pos;
+			data_len = len;
+			break;
+		}
+		if (!memcmp(c, "fmt ", 4) && len >= 16) {
+			if (pread(fd, c, 16, pos + 8) != 16) return -1;
+			const int tag = c[0] | c[1] << 8;
+			/* PCM, float, a-law, u-law, extensible: fixed size frames */
+			if (tag != 1 && tag != 3 && tag != 6 && tag != 7 && tag != 0xfffe) return -1;
+			w->block_align = c[12] | c[13] << 8;
+		}
+		if (!memcmp(c, "fact", 4) && len >= 4) {
+			w->fact_pos = pos + 8;
+		}
+		pos += 8 + (int64_t) len + (len & 1);
+	}
+	if (w->data_pos < 0 || w->block_align == 0) return -1;
+
+	/* data size is 0 or -1 for files that are still being written */
+	int64_t avail = flen - w->data_pos - 8;
+	if (data_len > 0 && data_len != 0xffffffff && data_len < avail) avail = data_len;
+	w->frames = avail / w->block_align;
+	return 0;
+}
+
 static int ad_info_sndfile(void *sf, struct adinfo *nfo) {
 	sndfile_audio_decoder *priv = (sndfile_audio_decoder*) sf;
 	if (!priv) return -1;
@@ -65,16 +176,43 @@ static int ad_info_sndfile(void *sf, struct adinfo *nfo) {
 }
 
 static void *ad_open_sndfile(const char *fn, struct adinfo *nfo) {
-	sndfile_audio_decoder *priv = (sndfile_audio_decoder*) calloc(1, sizeof(sndfile_audio_decoder));
+	sndfile_audio_decoder *priv = (sndfile_audio_decoder*) ad_pool_calloc(1, sizeof(sndfile_audio_decoder));
+	if (!priv) return NULL;
 	priv->sfinfo.format=0;
-	if(!(priv->sffile = sf_open(fn, SFM_READ, &priv->sfinfo))){
+	if(!(priv->sffile = sf_open_readahead(fn, &priv->sfinfo, &priv->io))){
 		dbg(0, "unable to open file '%s'.", fn);
 		puts(sf_strerror(NULL));
 		int e = sf_error(NULL);
 		dbg(0, "error=%i", e);
-		free(priv);
+		ad_pool_free(priv);
+		return NULL;
+	}
+	priv->fn = strdup(fn);
+	priv->data_pos = -1;
+	if ((priv->sfinfo.format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV) {
+		struct wav_layout w;
+		const int fd = open(fn, O_RDONLY);
+		if (fd >= 0 && !wav_parse(fd, &w)) {
+			priv->data_pos = w.data_pos + 8;
+			priv->block_align = w.block_align;
+		}
+		if (fd >= 0) close(fd);
+	}
+	ad_info_sndfile(priv, nfo);
+	return (void*) priv;
+}
+
+static void *ad_open_io_sndfile(ad_io *io, struct adinfo *nfo) {
+	sndfile_audio_decoder *priv = (sndfile_audio_decoder*) ad_pool_calloc(1, sizeof(sndfile_audio_decoder));
+	if (!priv) return NULL;
+	priv->sfinfo.format=0;
+	if(!(priv->sffile = sf_open_virtual(&ad_sf_vio, SFM_READ, &priv->sfinfo, io))){
+		dbg(1, "libsndfile can not read the stream: %s", sf_strerror(NULL));
+		ad_pool_free(priv);
 		return NULL;
 	}
+	priv->io = io;
+	priv->data_pos = -1;
 	ad_info_sndfile(priv, nfo);
 	return (void*) priv;
 }
@@ -86,7 +224,9 @@ static int ad_close_sndfile(void *sf) {
 		dbg(0, "fatal: bad file close.\n");
 		return -1;
 	}
-	free(priv);
+	ad_io_close(priv->io);
+	free(priv->fn);
+	ad_pool_free(priv);
 	return 0;
 }
 
@@ -102,6 +242,197 @@ static ssize_t ad_read_sndfile(void *sf, float* d, size_t len) {
 	return sf_read_float (priv->sffile, d, len);
 }
 
+/* sndfile formats have a single (multi-channel) stream */
+static int ad_streams_sndfile(void *sf, struct adinfo *nfo, int *index, int max) {
+	if (!sf) return -1;
+	if (max > 0) {
+		if (index) index[0] = 0;
+		if (nfo && ad_info_sndfile(sf, nfo)) return -1;
+	}
+	return 1;
+}
+
+static ssize_t ad_read_stream_sndfile(void *sf, float* d, size_t len, int *stream) {
+	if (stream) *stream = 0;
+	return ad_read_sndfile(sf, d, len);
+}
+
+static int ad_refresh_sndfile(void *sf, struct adinfo *nfo) {
+	sndfile_audio_decoder *priv = (sndfile_audio_decoder*) sf;
+	if (!priv || (!priv->io && !priv->fn)) return -1;
+	/* libsndfile caches the header, parse it again to pick up the new length.
+	 * With read-ahead I/O only the header view is renewed, the ad_io stays:
+	 * its length follows the file. */
+	SF_INFO sfinfo;
+	SNDFILE *sffile;
+	ad_io *io = priv->io;
+	const sf_count_t pos = sf_seek(priv->sffile, 0, SEEK_CUR);
+	sfinfo.format = 0;
+	if (pos < 0) {
+		return -1;
+	}
+	if (io) {
+		sffile = sf_open_virtual(&ad_sf_vio, SFM_READ, &sfinfo, io);
+	} else {
+		sffile = sf_open(priv->fn, SFM_READ, &sfinfo);
+	}
+	if (!sffile) {
+		sf_seek(priv->sffile, pos, SEEK_SET);
+		return -1;
+	}
+	if (sfinfo.channels != priv->sfinfo.channels
+			|| sfinfo.samplerate != priv->sfinfo.samplerate
+			|| sfinfo.frames < pos
+			|| sf_seek(sffile, pos, SEEK_SET) != pos) {
+		dbg(1, "file changed in an incompatible way.");
+		sf_close(sffile);
+		/* restore the I/O position of the previous view */
+		sf_seek(priv->sffile, pos, SEEK_SET);
+		return -1;
+	}
+	sf_close(priv->sffile);
+	priv->sffile = sffile;
+	priv->sfinfo = sfinfo;
+	dbg(2, "refreshed, frames: %"PRIi64, (int64_t) sfinfo.frames);
+	return ad_info_sndfile(priv, nfo);
+}
+
+/** lossless range copy of RIFF/WAVE files.
+ * Chunks before the audio data are copied, sizes are updated and the
+ * sample data is copied without conversion. Chunks following the data
+ * (cue points, late LIST) refer to the complete file and are dropped.
+ * The header is parsed once, all ranges are copied from the same file.
+ */
+static int wav_copy_ranges(const char *src, const char * const *dst, int64_t const *start, int64_t const *end, int n) {
+	unsigned char c[8];
+	struct wav_layout w;
+	int i, rv = -1;
+	const int fd_in = open(src, O_RDONLY);
+	if (fd_in < 0) return -1;
+
+	if (wav_parse(fd_in, &w)) goto out;
+
+	const int64_t data_pos = w.data_pos;
+	const int64_t fact_pos = w.fact_pos;
+	const int64_t avail = w.frames;
+	const uint32_t block_align = w.block_align;
+
+	rv = 0;
+	for (i = 0; i < n && rv == 0; ++i) {
+		const int64_t e = end[i] < avail ? end[i] : avail;
+		const int64_t s = start[i] < e ? start[i] : e;
+		const int64_t bytes = (e - s) * block_align;
+		const int64_t total = data_pos + 8 + bytes + (bytes & 1);
+		int fd_out;
+
+		if (total > 0xffffffffLL || (fd_out = open(dst[i], O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+			rv = -1;
+			break;
+		}
+
+		memcpy(c, "data", 4);
+		wr_le32(c + 4, bytes);
+		if (ad_io_copy_range(fd_in, 0, fd_out, data_pos)
+				|| write(fd_out, c, 8) != 8
+				|| ad_io_copy_range(fd_in, data_pos + 8 + s * block_align, fd_out, bytes)
+				|| ((bytes & 1) && write(fd_out, "", 1) != 1)) {
+			rv = -1;
+		}
+		wr_le32(c, total - 8);
+		wr_le32(c + 4, e - s);
+		if (rv || pwrite(fd_out, c, 4, 4) != 4 || (fact_pos > 0 && pwrite(fd_out, c + 4, 4, fact_pos) != 4)) {
+			rv = -1;
+		}
+		if (close(fd_out)) rv = -1;
+		if (rv) {
+			unlink(dst[i]);
+		} else {
+			dbg(1, "copied %"PRIi64" bytes of PCM data.", bytes);
+		}
+	}
+
+out:
+	close(fd_in);
+	return rv;
+}
+
+/** transcode ranges of frames to new files of the same format.
+ * Only formats that can be re-encoded without loss are supported.
+ */
+static int sf_copy_ranges(const char *src, const char * const *dst, int64_t const *start, int64_t const *end, int n) {
+	SF_INFO sfinfo, sfout;
+	SNDFILE *in, *out;
+	double buf[4096];
+	int i, rv = 0;
+
+	sfinfo.format = 0;
+	if (!(in = sf_open(src, SFM_READ, &sfinfo))) return -1;
+
+	switch (sfinfo.format & SF_FORMAT_SUBMASK) {
+		case SF_FORMAT_PCM_S8:
+		case SF_FORMAT_PCM_16:
+		case SF_FORMAT_PCM_24:
+		case SF_FORMAT_PCM_32:
+		case SF_FORMAT_PCM_U8:
+		case SF_FORMAT_FLOAT:
+		case SF_FORMAT_DOUBLE:
+		case SF_FORMAT_ULAW:
+		case SF_FORMAT_ALAW:
+			break;
+		default:
+			dbg(0, "lossy format, not copying.");
+			sf_close(in);
+			return -1;
+	}
+
+	/* integer samples pass through double without scaling, bit-exact */
+	sf_command(in, SFC_SET_NORM_DOUBLE, NULL, SF_FALSE);
+
+	const sf_count_t chunk = sizeof(buf) / sizeof(double) / sfinfo.channels;
+	for (i = 0; i < n && rv == 0; ++i) {
+		const int64_t e = end[i] < sfinfo.frames ? end[i] : sfinfo.frames;
+		const int64_t s = start[i] < e ? start[i] : e;
+		int64_t remain = e - s;
+
+		sfout = sfinfo;
+		sfout.frames = 0;
+		if (sf_seek(in, s, SEEK_SET) != s || !(out = sf_open(dst[i], SFM_WRITE, &sfout))) {
+			rv = -1;
+			break;
+		}
+		sf_command(out, SFC_SET_NORM_DOUBLE, NULL, SF_FALSE);
+
+		while (remain > 0) {
+			const sf_count_t k = sf_readf_double(in, buf, remain < chunk ? remain : chunk);
+			if (k <= 0 || sf_writef_double(out, buf, k) != k) {
+				rv = -1;
+				break;
+			}
+			remain -= k;
+		}
+		if (sf_close(out)) rv = -1;
+		if (rv) unlink(dst[i]);
+	}
+	sf_close(in);
+	return rv;
+}
+
+static int ad_copy_sndfile(void *sf, const char * const *fn, int64_t const *start, int64_t const *end, int n) {
+	sndfile_audio_decoder *priv = (sndfile_audio_decoder*) sf;
+	if (!priv || !priv->fn) return -1;
+	if ((priv->sfinfo.format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV
+			&& !wav_copy_ranges(priv->fn, fn, start, end, n)) {
+		return 0;
+	}
+	return sf_copy_ranges(priv->fn, fn, start, end, n);
+}
+
+static int64_t ad_byte_offset_sndfile(void *sf, int64_t frame) {
+	sndfile_audio_decoder *priv = (sndfile_audio_decoder*) sf;
+	if (!priv || priv->data_pos < 0) return -1;
+	return priv->data_pos + frame * priv->block_align;
+}
+
 static int ad_eval_sndfile(const char *f) { 
 	char *ext = strrchr(f, '.');
 	if (strstr (f, "://")) return 0;
@@ -138,14 +469,26 @@ static const ad_plugin ad_sndfile = {
 	&ad_close_sndfile,
 	&ad_info_sndfile,
 	&ad_seek_sndfile,
-	&ad_read_sndfile
+	&ad_read_sndfile,
+	&ad_refresh_sndfile,
+	&ad_open_io_sndfile,
+	&ad_streams_sndfile,
+	&ad_read_stream_sndfile,
+	&ad_copy_sndfile,
+	&ad_byte_offset_sndfile
 #else
   &ad_eval_null,
 	&ad_open_null,
 	&ad_close_null,
 	&ad_info_null,
 	&ad_seek_null,
-	&ad_read_null
+	&ad_read_null,
+	&ad_refresh_null,
+	&ad_open_io_null,
+	&ad_streams_null,
+	&ad_read_stream_null,
+	&ad_copy_null,
+	&ad_byte_offset_null
 #endif
 };
 
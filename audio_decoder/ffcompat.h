@@ -37,10 +37,19 @@
 #define AVCODEC_MAX_AUDIO_FRAME_SIZE 192000
 #endif
 
+#ifndef AVIO_SEEKABLE_NORMAL
+#define AVIO_SEEKABLE_NORMAL 1
+#endif
+
 #if LIBAVUTIL_VERSION_INT < AV_VERSION_INT(50, 0, 0)
 #define AVMEDIA_TYPE_AUDIO CODEC_TYPE_AUDIO
 #endif
 
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(54, 25, 0)
+#define AV_CODEC_ID_PCM_S16LE CODEC_ID_PCM_S16LE
+#define AV_CODEC_ID_PCM_S16BE CODEC_ID_PCM_S16BE
+#endif
+
 #if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(53, 2, 0)
 static inline int avformat_open_input(AVFormatContext **ps, const char *filename, void *fmt, void **options)
 {
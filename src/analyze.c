@@ -0,0 +1,378 @@
+/* silan - silence analyzer
+ *
+ * Copyright (C) 2012-2018 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "config.h"
+#include "silan.h"
+
+/* analyzers that run alongside the silence detection.
+ *
+ * Every stage gets the same decoded buffer (interleaved float), so
+ * a complete quality-control pass costs a single decode of the file.
+ */
+
+/** a clipping run is at least CLIP_RUN consecutive samples at full-scale */
+#define CLIP_RUN (3)
+/** full-scale of 16bit audio, decoded as 32767/32768 */
+#define CLIP_LEVEL (.99996f)
+
+/** true-peak: 4x oversampling, 12 taps per phase, see ITU-R BS.1770 Annex 2 */
+#define TP_PHASES (4)
+#define TP_TAPS (12)
+
+#ifndef M_PI
+#define M_PI (3.14159265358979323846)
+#endif
+
+struct stage {
+	void *h;
+	void (*process) (void *h, float const * const buf, const unsigned int n_frames);
+	void (*report) (void *h, FILE *f, const int json);
+	void (*close) (void *h);
+};
+
+struct analyzers {
+	struct stage stage[4];
+	int n_stages;
+};
+
+/* clipping */
+
+struct clip {
+	unsigned int channels;
+	unsigned int sample_rate;
+	int64_t *run;     // per channel, length of the current run
+	int64_t pos;      // frames processed
+	int64_t runs;
+	int64_t samples;  // samples in clipping runs
+	int64_t longest;
+	int64_t first;    // frame-number of the first run, -1: none
+};
+
+static void clip_end(struct clip *cl, const unsigned int c) {
+	const int64_t n = cl->run[c];
+	cl->run[c] = 0;
+	if (n < CLIP_RUN) return;
+	++cl->runs;
+	cl->samples += n;
+	if (n > cl->longest) cl->longest = n;
+	if (cl->first < 0 || cl->pos - n < cl->first) cl->first = cl->pos - n;
+}
+
+static void clip_process(void *h, float const * const buf, const unsigned int n_frames) {
+	struct clip *cl = (struct clip*) h;
+	const unsigned int nch = cl->channels;
+	unsigned int i, c;
+	for (i = 0; i < n_frames; ++i, ++cl->pos) {
+		for (c = 0; c < nch; ++c) {
+			if (fabsf(buf[i * nch + c]) >= CLIP_LEVEL) {
+				++cl->run[c];
+			} else if (cl->run[c] > 0) {
+				clip_end(cl, c);
+			}
+		}
+	}
+}
+
+static void clip_report(void *h, FILE *f, const int json) {
+	struct clip *cl = (struct clip*) h;
+	unsigned int c;
+	/* runs that last until the end of the file */
+	for (c = 0; c < cl->channels; ++c) {
+		clip_end(cl, c);
+	}
+	if (json) {
+		fprintf(f, "\"clipping\":{\"runs\":%"PRIi64", \"samples\":%"PRIi64", \"longest\":%"PRIi64", \"first\":",
+				cl->runs, cl->samples, cl->longest);
+		if (cl->first >= 0)
+			fprintf(f, "%lf}", (double) cl->first / cl->sample_rate);
+		else
+			fprintf(f, "null}");
+	} else {
+		fprintf(f, "Clipping: %"PRIi64" runs, %"PRIi64" samples, longest %"PRIi64,
+				cl->runs, cl->samples, cl->longest);
+		if (cl->first >= 0)
+			fprintf(f, ", first at %lf", (double) cl->first / cl->sample_rate);
+		fprintf(f, "\n");
+	}
+}
+
+static void clip_close(void *h) {
+	struct clip *cl = (struct clip*) h;
+	free(cl->run);
+	free(cl);
+}
+
+static void *clip_open(struct adinfo const * const nfo) {
+	struct clip *cl = (struct clip*) calloc(1, sizeof(struct clip));
+	if (!cl) return NULL;
+	cl->channels = nfo->channels;
+	cl->sample_rate = nfo->sample_rate;
+	cl->first = -1;
+	if (!(cl->run = (int64_t*) calloc(nfo->channels, sizeof(int64_t)))) {
+		free(cl);
+		return NULL;
+	}
+	return cl;
+}
+
+/* DC offset */
+
+struct dc {
+	unsigned int channels;
+	double *sum;  // per channel
+	int64_t cnt;
+};
+
+static void dc_process(void *h, float const * const buf, const unsigned int n_frames) {
+	struct dc *dc = (struct dc*) h;
+	const unsigned int nch = dc->channels;
+	unsigned int i, c;
+	for (i = 0; i < n_frames; ++i) {
+		for (c = 0; c < nch; ++c) {
+			dc->sum[c] += buf[i * nch + c];
+		}
+	}
+	dc->cnt += n_frames;
+}
+
+static void dc_report(void *h, FILE *f, const int json) {
+	struct dc *dc = (struct dc*) h;
+	unsigned int c;
+	fprintf(f, json ? "\"dc offset\":[" : "DC offset:");
+	for (c = 0; c < dc->channels; ++c) {
+		const double v = dc->cnt > 0 ? dc->sum[c] / dc->cnt : 0;
+		if (json)
+			fprintf(f, "%s%.6f", c ? ", " : "", v);
+		else
+			fprintf(f, " %.6f", v);
+	}
+	fprintf(f, json ? "]" : "\n");
+}
+
+static void dc_close(void *h) {
+	struct dc *dc = (struct dc*) h;
+	free(dc->sum);
+	free(dc);
+}
+
+static void *dc_open(struct adinfo const * const nfo) {
+	struct dc *dc = (struct dc*) calloc(1, sizeof(struct dc));
+	if (!dc) return NULL;
+	dc->channels = nfo->channels;
+	if (!(dc->sum = (double*) calloc(nfo->channels, sizeof(double)))) {
+		free(dc);
+		return NULL;
+	}
+	return dc;
+}
+
+/* sample-peak and true-peak */
+
+struct peak {
+	unsigned int channels;
+	float *sample;   // per channel
+	float *true_pk;  // per channel
+	float *hist;     // per channel, 2 * TP_TAPS, the history is duplicated to avoid wrapping
+	unsigned int pos;
+	float coeff[TP_PHASES][TP_TAPS];
+};
+
+/* windowed-sinc interpolation filter, every phase is normalized to unity gain */
+static void peak_init_filter(struct peak *pk) {
+	const int n = TP_PHASES * TP_TAPS;
+	int p, k;
+	for (p = 0; p < TP_PHASES; ++p) {
+		double sum = 0;
+		for (k = 0; k < TP_TAPS; ++k) {
+			const int i = k * TP_PHASES + p;
+			const double x = (i - .5 * (n - 1)) / TP_PHASES;
+			const double w = .42 - .5 * cos(2. * M_PI * (i + .5) / n) + .08 * cos(4. * M_PI * (i + .5) / n);
+			const double v = (x == 0 ? 1.0 : sin(M_PI * x) / (M_PI * x)) * w;
+			pk->coeff[p][k] = v;
+			sum += v;
+		}
+		for (k = 0; k < TP_TAPS; ++k) {
+			pk->coeff[p][k] /= sum;
+		}
+	}
+}
+
+static void peak_process(void *h, float const * const buf, const unsigned int n_frames) {
+	struct peak *pk = (struct peak*) h;
+	const unsigned int nch = pk->channels;
+	unsigned int i, c, p, k;
+	for (i = 0; i < n_frames; ++i) {
+		pk->pos = (pk->pos + TP_TAPS - 1) % TP_TAPS;
+		for (c = 0; c < nch; ++c) {
+			const float v = buf[i * nch + c];
+			float * const hist = &pk->hist[c * 2 * TP_TAPS];
+			if (fabsf(v) > pk->sample[c]) pk->sample[c] = fabsf(v);
+
+			/* hist[pos ..] is the most recent TP_TAPS samples, newest first */
+			hist[pk->pos] = hist[pk->pos + TP_TAPS] = v;
+			float const * const x = &hist[pk->pos];
+			for (p = 0; p < TP_PHASES; ++p) {
+				float y = 0;
+				for (k = 0; k < TP_TAPS; ++k) {
+					y += pk->coeff[p][k] * x[k];
+				}
+				if (fabsf(y) > pk->true_pk[c]) pk->true_pk[c] = fabsf(y);
+			}
+		}
+	}
+}
+
+/* level in dB, silence is reported as the floor instead of -inf */
+static double peak_db(const float v) {
+	return v > 1e-10f ? 20.0 * log10f(v) : -200.0;
+}
+
+static void peak_report(void *h, FILE *f, const int json) {
+	struct peak *pk = (struct peak*) h;
+	unsigned int c;
+	/* the interpolated signal includes the samples */
+	for (c = 0; c < pk->channels; ++c) {
+		if (pk->sample[c] > pk->true_pk[c]) pk->true_pk[c] = pk->sample[c];
+	}
+	if (json) {
+		fprintf(f, "\"sample peak\":[");
+		for (c = 0; c < pk->channels; ++c)
+			fprintf(f, "%s%.6f", c ? ", " : "", pk->sample[c]);
+		fprintf(f, "], \"true peak\":[");
+		for (c = 0; c < pk->channels; ++c)
+			fprintf(f, "%s%.6f", c ? ", " : "", pk->true_pk[c]);
+		fprintf(f, "]");
+	} else {
+		fprintf(f, "Sample peak:");
+		for (c = 0; c < pk->channels; ++c)
+			fprintf(f, " %.2f", peak_db(pk->sample[c]));
+		fprintf(f, " dBFS\nTrue peak:");
+		for (c = 0; c < pk->channels; ++c)
+			fprintf(f, " %.2f", peak_db(pk->true_pk[c]));
+		fprintf(f, " dBTP\n");
+	}
+}
+
+static void peak_close(void *h) {
+	struct peak *pk = (struct peak*) h;
+	free(pk->sample);
+	free(pk->true_pk);
+	free(pk->hist);
+	free(pk);
+}
+
+static void *peak_open(struct adinfo const * const nfo) {
+	struct peak *pk = (struct peak*) calloc(1, sizeof(struct peak));
+	if (!pk) return NULL;
+	pk->channels = nfo->channels;
+	pk->sample = (float*) calloc(nfo->channels, sizeof(float));
+	pk->true_pk = (float*) calloc(nfo->channels, sizeof(float));
+	pk->hist = (float*) calloc(nfo->channels * 2 * TP_TAPS, sizeof(float));
+	if (!pk->sample || !pk->true_pk || !pk->hist) {
+		peak_close(pk);
+		return NULL;
+	}
+	peak_init_filter(pk);
+	return pk;
+}
+
+/* pipeline */
+
+static int add_stage(struct analyzers *a, void *h,
+		void (*process) (void*, float const * const, const unsigned int),
+		void (*report) (void*, FILE*, const int),
+		void (*close) (void*)) {
+	if (!h) return -1;
+	a->stage[a->n_stages].h = h;
+	a->stage[a->n_stages].process = process;
+	a->stage[a->n_stages].report = report;
+	a->stage[a->n_stages].close = close;
+	++a->n_stages;
+	return 0;
+}
+
+void *analyze_open(struct silan_settings const * const ss, struct adinfo const * const nfo) {
+	struct analyzers *a;
+	int err = 0;
+
+	if (!ss->envelope && !ss->analyze) return NULL;
+
+	a = (struct analyzers*) calloc(1, sizeof(struct analyzers));
+	if (!a) return NULL;
+
+	if (ss->envelope) {
+		/* envelope_open reports errors */
+		if (add_stage(a, envelope_open(ss, nfo), &envelope_process, NULL, &envelope_close)) {
+			analyze_close(a);
+			return NULL;
+		}
+	}
+	if (ss->analyze & A_CLIP) {
+		err |= add_stage(a, clip_open(nfo), &clip_process, &clip_report, &clip_close);
+	}
+	if (ss->analyze & A_DC) {
+		err |= add_stage(a, dc_open(nfo), &dc_process, &dc_report, &dc_close);
+	}
+	if (ss->analyze & A_PEAK) {
+		err |= add_stage(a, peak_open(nfo), &peak_process, &peak_report, &peak_close);
+	}
+	if (err) {
+		if (debug_level >= 0)
+			fprintf(stderr, "! out-of-memory\n");
+		analyze_close(a);
+		return NULL;
+	}
+	return a;
+}
+
+void analyze_process(void *h, float const * const buf, const unsigned int n_frames) {
+	struct analyzers *a = (struct analyzers*) h;
+	int i;
+	if (!a) return;
+	for (i = 0; i < a->n_stages; ++i) {
+		a->stage[i].process(a->stage[i].h, buf, n_frames);
+	}
+}
+
+void analyze_report(void *h, FILE *f, const int json) {
+	struct analyzers *a = (struct analyzers*) h;
+	int i, cnt = 0;
+	if (!a) return;
+	for (i = 0; i < a->n_stages; ++i) {
+		if (!a->stage[i].report) continue;
+		if (json) fprintf(f, cnt ? ", " : ", \"analysis\":{");
+		a->stage[i].report(a->stage[i].h, f, json);
+		++cnt;
+	}
+	if (json && cnt) fprintf(f, "}");
+}
+
+void analyze_close(void *h) {
+	struct analyzers *a = (struct analyzers*) h;
+	int i;
+	if (!a) return;
+	for (i = 0; i < a->n_stages; ++i) {
+		a->stage[i].close(a->stage[i].h);
+	}
+	free(a);
+}
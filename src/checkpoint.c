@@ -0,0 +1,226 @@
+/* silan - silence analyzer
+ *
+ * Copyright (C) 2012-2018 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "silan.h"
+
+/* checkpoint file layout (host byte-order, not portable across machines):
+ *
+ *  header   : magic, version
+ *  settings : parameters that affect the analysis result or the output
+ *  file     : audio properties, size and modification time of the file
+ *  position : frames processed, output-file offset
+ *  state    : silan_state scalars, followed by
+ *             hpf_x[channels], hpf_y[channels], window[window_size]
+ */
+
+#define CKP_MAGIC "silanCKP"
+#define CKP_VERSION (3)
+
+struct ckp_header {
+	char     magic[8];
+	int32_t  version;
+	/* settings fingerprint */
+	float    threshold;
+	float    hpf_tc;
+	float    holdoff_sec;
+	int32_t  printmode;
+	int32_t  printformat;
+	int32_t  first_last_only;
+	int32_t  include_initial;
+	uint32_t template_hash;
+	/* file fingerprint */
+	uint32_t sample_rate;
+	uint32_t channels;
+	int64_t  frames;
+	int64_t  file_size;  // -1: not a local file
+	int64_t  file_mtime;
+	/* position */
+	int64_t  frame_cnt;
+	int64_t  out_offset;
+	/* state */
+	double   rms_sum;
+	int32_t  window_size;
+	int32_t  window_pos;
+	int32_t  state;
+	int32_t  first_last;
+	int32_t  cnt;
+	int64_t  holdoff;
+	int64_t  prev_on;
+	int64_t  prev_on_offset;
+	int64_t  prev_off;
+	int64_t  initial_silence_countdown;
+};
+
+static void fill_fingerprint(struct ckp_header *h,
+		struct silan_settings const * const ss,
+		struct adinfo const * const nfo) {
+	struct stat fs;
+	memset(h, 0, sizeof(struct ckp_header));
+	memcpy(h->magic, CKP_MAGIC, 8);
+	h->version         = CKP_VERSION;
+	h->threshold       = ss->threshold;
+	h->hpf_tc          = ss->hpf_tc;
+	h->holdoff_sec     = ss->holdoff_sec;
+	h->printmode       = ss->printmode;
+	h->printformat     = ss->sinks[0].printformat;
+	h->first_last_only = ss->first_last_only;
+	h->include_initial = ss->include_initial;
+	h->template_hash   = template_hash(ss->sinks[0].tpl);
+	h->sample_rate     = nfo->sample_rate;
+	h->channels        = nfo->channels;
+	h->frames          = nfo->frames;
+	h->file_size       = -1;
+	if (!stat(ss->fn, &fs)) {
+		h->file_size   = fs.st_size;
+		h->file_mtime  = fs.st_mtime;
+	}
+}
+
+int checkpoint_save (struct silan_settings const * const ss, struct adinfo const * const nfo,
+		struct silan_state const * const st, const int64_t frame_cnt) {
+	struct ckp_header h;
+	const size_t nch = nfo->channels;
+	char *tmp;
+	FILE *f;
+	int ok = 1;
+
+	fill_fingerprint(&h, ss, nfo);
+	fflush(ss->sinks[0].outfile);
+	h.frame_cnt   = frame_cnt;
+	h.out_offset  = ftello(ss->sinks[0].outfile);
+	h.rms_sum     = st->rms_sum;
+	h.window_size = st->window_size;
+	h.window_pos  = st->window_cur - st->window;
+	h.state       = st->state;
+	h.first_last  = st->first_last;
+	h.cnt         = st->fmt[0].cnt;
+	h.holdoff     = st->holdoff;
+	h.prev_on     = st->fmt[0].prev_on;
+	h.prev_on_offset = st->fmt[0].prev_on_offset;
+	h.prev_off    = st->prev_off;
+	h.initial_silence_countdown = st->initial_silence_countdown;
+
+	tmp = malloc(strlen(ss->checkpoint) + 5);
+	if (!tmp) return -1;
+	sprintf(tmp, "%s.tmp", ss->checkpoint);
+
+	if (!(f = fopen(tmp, "wb"))) {
+		if (debug_level >= 0)
+			fprintf(stderr, "! cannot write checkpoint '%s'.\n", tmp);
+		free(tmp);
+		return -1;
+	}
+
+	ok &= fwrite(&h, sizeof(struct ckp_header), 1, f) == 1;
+	ok &= fwrite(st->hpf_x, sizeof(float), nch, f) == nch;
+	ok &= fwrite(st->hpf_y, sizeof(float), nch, f) == nch;
+	ok &= fwrite(st->window, sizeof(float), st->window_size, f) == (size_t) st->window_size;
+	ok &= fflush(f) == 0;
+	ok &= fsync(fileno(f)) == 0;
+	ok &= fclose(f) == 0;
+
+	/* replace previous checkpoint only once the new one is complete */
+	if (!ok || rename(tmp, ss->checkpoint)) {
+		if (debug_level >= 0)
+			fprintf(stderr, "! failed to save checkpoint '%s': %s\n", ss->checkpoint, strerror(errno));
+		unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+	free(tmp);
+	return 0;
+}
+
+int checkpoint_load (struct silan_settings const * const ss, struct adinfo const * const nfo,
+		struct silan_state * const st, int64_t *frame_cnt, int64_t *out_offset) {
+	struct ckp_header h, ref;
+	const size_t nch = nfo->channels;
+	FILE *f;
+	int ok = 1;
+
+	if (!(f = fopen(ss->checkpoint, "rb"))) {
+		return (errno == ENOENT) ? 1 : -1;
+	}
+
+	fill_fingerprint(&ref, ss, nfo);
+
+	if (fread(&h, sizeof(struct ckp_header), 1, f) != 1
+			|| memcmp(h.magic, ref.magic, 8) || h.version != ref.version) {
+		if (debug_level >= 0)
+			fprintf(stderr, "! '%s' is not a valid checkpoint file.\n", ss->checkpoint);
+		fclose(f);
+		return -1;
+	}
+
+	if (h.threshold != ref.threshold || h.hpf_tc != ref.hpf_tc || h.holdoff_sec != ref.holdoff_sec
+			|| h.printmode != ref.printmode || h.printformat != ref.printformat
+			|| h.first_last_only != ref.first_last_only || h.include_initial != ref.include_initial
+			|| h.template_hash != ref.template_hash
+			|| h.sample_rate != ref.sample_rate || h.channels != ref.channels
+			/* the file may grow in follow mode */
+			|| (h.frames != ref.frames && !ss->follow)
+			|| (h.file_size != ref.file_size && !(ss->follow && ref.file_size > h.file_size))
+			|| (h.file_mtime != ref.file_mtime && !ss->follow)
+			|| h.window_size != st->window_size
+			|| h.window_pos < 0 || h.window_pos >= h.window_size
+			|| h.frame_cnt < 0 || h.frame_cnt > nfo->frames) {
+		if (debug_level >= 0)
+			fprintf(stderr, "! checkpoint '%s' does not match file or settings.\n", ss->checkpoint);
+		fclose(f);
+		return -1;
+	}
+
+	ok &= fread(st->hpf_x, sizeof(float), nch, f) == nch;
+	ok &= fread(st->hpf_y, sizeof(float), nch, f) == nch;
+	ok &= fread(st->window, sizeof(float), st->window_size, f) == (size_t) st->window_size;
+	fclose(f);
+
+	if (!ok) {
+		if (debug_level >= 0)
+			fprintf(stderr, "! checkpoint '%s' is truncated.\n", ss->checkpoint);
+		return -1;
+	}
+
+	st->rms_sum    = h.rms_sum;
+	st->window_cur = st->window + h.window_pos;
+	st->state      = h.state;
+	st->first_last = h.first_last;
+	st->fmt[0].cnt = h.cnt;
+	st->holdoff    = h.holdoff;
+	st->fmt[0].prev_on = h.prev_on;
+	st->fmt[0].prev_on_offset = h.prev_on_offset;
+	st->prev_off   = h.prev_off;
+	st->initial_silence_countdown = h.initial_silence_countdown;
+
+	*frame_cnt  = h.frame_cnt;
+	*out_offset = h.out_offset;
+	return 0;
+}
+
+void checkpoint_remove (struct silan_settings const * const ss) {
+	if (ss->checkpoint) {
+		unlink(ss->checkpoint);
+	}
+}
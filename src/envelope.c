@@ -0,0 +1,153 @@
+/* silan - silence analyzer
+ *
+ * Copyright (C) 2012-2018 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "config.h"
+#include "silan.h"
+
+/* binary envelope file layout (host byte-order):
+ *
+ *  header : magic "silanENV", uint32 version, channels, sample-rate, block-size
+ *  blocks : float peak, float rms -- for each channel, for each block
+ *
+ * The last block may be shorter than block-size.
+ */
+
+#define ENV_MAGIC "silanENV"
+#define ENV_VERSION (1)
+
+struct envelope {
+	FILE *f;
+	int json;
+	unsigned int channels;
+	unsigned int block;  // frames per block
+	unsigned int pos;    // frames in current block
+	int64_t cnt;         // blocks written
+	float  *peak;        // per channel
+	double *sum;         // sum of squares, per channel
+};
+
+void *envelope_open(struct silan_settings const * const ss, struct adinfo const * const nfo) {
+	struct envelope *env;
+	const char *ext;
+
+	if (!ss->envelope) return NULL;
+
+	env = (struct envelope*) calloc(1, sizeof(struct envelope));
+	if (!env) return NULL;
+
+	env->channels = nfo->channels;
+	env->block = ss->envelope_block;
+	env->peak = (float*) calloc(env->channels, sizeof(float));
+	env->sum = (double*) calloc(env->channels, sizeof(double));
+	ext = strrchr(ss->envelope, '.');
+	env->json = ext && !strcasecmp(ext, ".json");
+
+	if (!env->peak || !env->sum || !(env->f = fopen(ss->envelope, env->json ? "w" : "wb"))) {
+		if (debug_level >= 0)
+			fprintf(stderr, "! cannot open envelope file '%s'.\n", ss->envelope);
+		free(env->peak);
+		free(env->sum);
+		free(env);
+		return NULL;
+	}
+
+	if (env->json) {
+		fprintf(env->f, "{ \"sample rate\":%u, \"channels\":%u, \"block size\":%u, \"envelope\":[",
+				nfo->sample_rate, env->channels, env->block);
+	} else {
+		uint32_t hdr[4] = { ENV_VERSION, env->channels, nfo->sample_rate, env->block };
+		fwrite(ENV_MAGIC, 1, 8, env->f);
+		fwrite(hdr, sizeof(uint32_t), 4, env->f);
+	}
+	return env;
+}
+
+static void envelope_flush(struct envelope *env) {
+	unsigned int c;
+	if (env->pos == 0) return;
+
+	if (env->json) {
+		fprintf(env->f, "%s[", env->cnt ? ",\n " : "\n ");
+		for (c = 0; c < env->channels; ++c) {
+			fprintf(env->f, "%s%.6f, %.6f", c ? ", " : "",
+					env->peak[c], sqrt(env->sum[c] / env->pos));
+		}
+		fprintf(env->f, "]");
+	} else {
+		for (c = 0; c < env->channels; ++c) {
+			float v[2] = { env->peak[c], (float) sqrt(env->sum[c] / env->pos) };
+			fwrite(v, sizeof(float), 2, env->f);
+		}
+	}
+	++env->cnt;
+	env->pos = 0;
+	memset(env->peak, 0, env->channels * sizeof(float));
+	memset(env->sum, 0, env->channels * sizeof(double));
+}
+
+/** accumulate peak and RMS of interleaved audio data */
+void envelope_process(void *h, float const * const buf, const unsigned int n_frames) {
+	struct envelope *env = (struct envelope*) h;
+	unsigned int i = 0, c;
+	if (!env) return;
+
+	const unsigned int nch = env->channels;
+	float  * const peak = env->peak;
+	double * const sum = env->sum;
+
+	while (i < n_frames) {
+		unsigned int n = env->block - env->pos;
+		if (n > n_frames - i) n = n_frames - i;
+
+		float const *b = &buf[i * nch];
+		const float * const e = b + n * nch;
+		for (; b < e; b += nch) {
+			for (c = 0; c < nch; ++c) {
+				const float v = fabsf(b[c]);
+				if (v > peak[c]) peak[c] = v;
+				sum[c] += b[c] * b[c];
+			}
+		}
+
+		i += n;
+		env->pos += n;
+		if (env->pos == env->block) {
+			envelope_flush(env);
+		}
+	}
+}
+
+void envelope_close(void *h) {
+	struct envelope *env = (struct envelope*) h;
+	if (!env) return;
+	envelope_flush(env);
+	if (env->json) {
+		fprintf(env->f, "\n]}\n");
+	}
+	if (fclose(env->f) && debug_level >= 0) {
+		fprintf(stderr, "! error writing envelope file.\n");
+	}
+	free(env->peak);
+	free(env->sum);
+	free(env);
+}
@@ -0,0 +1,161 @@
+/* silan - silence analyzer
+ *
+ * Copyright (C) 2012-2018 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "silan.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+/* interval to check for interruption or to poll the file [ms] */
+#define FOLLOW_POLL_MS (500)
+
+struct follow {
+	char *fn;
+	int fd; // inotify, -1: poll stat()
+	int wd;
+	off_t size;
+	time_t mtime;
+};
+
+static volatile sig_atomic_t follow_interrupted = 0;
+
+static void catchsig (int sig) {
+	UNUSED(sig);
+	follow_interrupted = 1;
+}
+
+void *follow_open(const char *fn) {
+	struct follow *fw = (struct follow*) calloc(1, sizeof(struct follow));
+	struct stat st;
+	if (!fw) return NULL;
+
+	fw->fn = strdup(fn);
+	fw->fd = -1;
+
+	if (stat(fn, &st) == 0) {
+		fw->size = st.st_size;
+		fw->mtime = st.st_mtime;
+	}
+
+#ifdef HAVE_SYS_INOTIFY_H
+	fw->fd = inotify_init();
+	if (fw->fd >= 0) {
+		fw->wd = inotify_add_watch(fw->fd, fn,
+				IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+		if (fw->wd < 0) {
+			close(fw->fd);
+			fw->fd = -1;
+		}
+	}
+	if (fw->fd < 0 && debug_level > 0) {
+		fprintf(stderr, "Note: inotify is not available, polling file.\n");
+	}
+#endif
+
+	/* end following gracefully, still closing the output */
+	signal(SIGINT, catchsig);
+	signal(SIGTERM, catchsig);
+	return fw;
+}
+
+void follow_close(void *h) {
+	struct follow *fw = (struct follow*) h;
+	if (!fw) return;
+#ifdef HAVE_SYS_INOTIFY_H
+	if (fw->fd >= 0) {
+		close(fw->fd);
+	}
+#endif
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	free(fw->fn);
+	free(fw);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+static int follow_wait_inotify(struct follow *fw) {
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfd;
+	pfd.fd = fw->fd;
+	pfd.events = POLLIN;
+
+	while (!follow_interrupted) {
+		int rv = poll(&pfd, 1, FOLLOW_POLL_MS);
+		if (rv < 0 && errno != EINTR) return 1;
+		if (rv <= 0) continue;
+
+		ssize_t len = read(fw->fd, buf, sizeof(buf));
+		if (len <= 0) return 1;
+
+		int changed = 0;
+		char *p;
+		for (p = buf; p < buf + len; ) {
+			const struct inotify_event *ev = (const struct inotify_event *) p;
+			if (ev->mask & (IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+				/* the writer is done. Any data written before is drained
+				 * by the caller, so there is no need to look further. */
+				return 1;
+			}
+			if (ev->mask & IN_MODIFY) {
+				changed = 1;
+			}
+			p += sizeof(struct inotify_event) + ev->len;
+		}
+		if (changed) return 0;
+	}
+	return 1;
+}
+#endif
+
+static int follow_wait_poll(struct follow *fw) {
+	while (!follow_interrupted) {
+		struct stat st;
+		if (stat(fw->fn, &st)) {
+			return 1;
+		}
+		if (st.st_size != fw->size || st.st_mtime != fw->mtime) {
+			fw->size = st.st_size;
+			fw->mtime = st.st_mtime;
+			return 0;
+		}
+		usleep(FOLLOW_POLL_MS * 1000);
+	}
+	return 1;
+}
+
+int follow_wait(void *h) {
+	struct follow *fw = (struct follow*) h;
+	if (!fw) return 1;
+#ifdef HAVE_SYS_INOTIFY_H
+	if (fw->fd >= 0) {
+		return follow_wait_inotify(fw);
+	}
+#endif
+	return follow_wait_poll(fw);
+}
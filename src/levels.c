@@ -0,0 +1,172 @@
+/* silan - silence analyzer
+ *
+ * Copyright (C) 2012-2018 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "config.h"
+#include "silan.h"
+
+/* RMS window energies, recorded for --relative.
+ *
+ * The reference level is computed from statistics: values above the
+ * absolute gate are counted in bins of 0.01dB, each bin keeps the exact
+ * sum of its values. The relative gate is resolved to a bin, values within
+ * 0.01dB of it may be counted on the wrong side of the gate.
+ *
+ * The envelope that is replayed to find the events is kept at a coarser
+ * rate once it is long: when LEVEL_ENVELOPE values are stored, adjacent
+ * pairs are merged (mean energy), and each value from then on covers twice
+ * as many levels. Up to 2^22 * 64 frames (93 minutes at 48kHz) every level
+ * is kept; for 24 hours at 48kHz a value covers 1024 frames (21ms).
+ */
+
+/* bins per decade of energy (10dB) */
+#define LEVEL_BINS_DECADE (1000)
+
+/* 100dB above the absolute gate, louder values are counted in the last bin */
+#define LEVEL_BINS (10 * LEVEL_BINS_DECADE)
+
+/* maximum number of envelope values (16 MiB) */
+#define LEVEL_ENVELOPE (1 << 22)
+
+struct levels {
+	double  gate;
+	double  max;
+	double  sum[LEVEL_BINS];
+	int64_t cnt[LEVEL_BINS];
+
+	float  *e;      // envelope
+	int64_t n;
+	int64_t alloc;
+	int     span;   // levels per envelope value, a power of two
+	double  acc;    // sum of the levels of the next value
+	int     acc_n;
+};
+
+static int level_bin(struct levels const *lv, const double energy) {
+	const int b = floor(LEVEL_BINS_DECADE * log10(energy / lv->gate));
+	if (b < 0) return 0;
+	return b < LEVEL_BINS ? b : LEVEL_BINS - 1;
+}
+
+void *levels_open(const double gate) {
+	struct levels *lv = (struct levels*) calloc(1, sizeof(struct levels));
+	if (!lv) return NULL;
+	lv->alloc = 65536;
+	if (!(lv->e = (float*) malloc(lv->alloc * sizeof(float)))) {
+		free(lv);
+		return NULL;
+	}
+	lv->gate = gate;
+	lv->span = 1;
+	return lv;
+}
+
+/* make room for one more envelope value: grow the array, or halve the
+ * envelope's rate in place once it is at the limit (or out of memory).
+ * @return 1 if the rate was halved
+ */
+static int levels_room(struct levels *lv) {
+	int64_t i;
+	if (lv->n < lv->alloc) {
+		return 0;
+	}
+	if (lv->alloc < LEVEL_ENVELOPE) {
+		float *e = (float*) realloc(lv->e, 2 * lv->alloc * sizeof(float));
+		if (e) {
+			lv->e = e;
+			lv->alloc *= 2;
+			return 0;
+		}
+	}
+	/* n == alloc is even */
+	for (i = 0; i < lv->n / 2; ++i) {
+		lv->e[i] = .5f * (lv->e[2 * i] + lv->e[2 * i + 1]);
+	}
+	lv->n /= 2;
+	lv->span *= 2;
+	return 1;
+}
+
+void levels_add(void *h, const float energy) {
+	struct levels *lv = (struct levels*) h;
+	if (energy > lv->max) lv->max = energy;
+	if (energy > lv->gate) {
+		const int b = level_bin(lv, energy);
+		lv->sum[b] += energy;
+		lv->cnt[b]++;
+	}
+	lv->acc += energy;
+	if (++lv->acc_n < lv->span) {
+		return;
+	}
+	if (levels_room(lv)) {
+		/* the levels so far are half of the next value */
+		return;
+	}
+	lv->e[lv->n++] = lv->acc / lv->span;
+	lv->acc = 0;
+	lv->acc_n = 0;
+}
+
+float const *levels_data(void *h, int64_t *n, int *span) {
+	struct levels *lv = (struct levels*) h;
+	if (lv->acc_n > 0) {
+		/* the last, partial value */
+		levels_room(lv);
+		lv->e[lv->n++] = lv->acc / lv->acc_n;
+		lv->acc = 0;
+		lv->acc_n = 0;
+	}
+	*n = lv->n;
+	*span = lv->span;
+	return lv->e;
+}
+
+/* the gating follows ITU-R BS.1770: the absolute gate excludes silence,
+ * the relative gate (-10dB) excludes quiet passages. */
+double levels_reference(void *h, const int peak) {
+	struct levels *lv = (struct levels*) h;
+	double sum = 0;
+	int64_t cnt = 0;
+	int b;
+
+	for (b = 0; b < LEVEL_BINS; ++b) {
+		sum += lv->sum[b];
+		cnt += lv->cnt[b];
+	}
+	if (peak || cnt == 0) {
+		return lv->max;
+	}
+
+	const double rel_gate = .1 * sum / cnt;
+	sum = 0; cnt = 0;
+	for (b = rel_gate > lv->gate ? level_bin(lv, rel_gate) : 0; b < LEVEL_BINS; ++b) {
+		sum += lv->sum[b];
+		cnt += lv->cnt[b];
+	}
+	return cnt > 0 ? sum / cnt : lv->max;
+}
+
+void levels_close(void *h) {
+	struct levels *lv = (struct levels*) h;
+	if (!lv) return;
+	free(lv->e);
+	free(lv);
+}
@@ -21,210 +21,396 @@
 #include <strings.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <math.h>
 
 #include "ad.h"
+#include "ad_pool.h"
 #include "config.h"
+#include "silan.h"
 
 int debug_level = 0;
-#define PERIODSIZE (1024)
-
-enum {
-	B_EN = 1,  ///< enable first/last mode
-	B_FAST = 2,///< enable 'fast' mode (process backwards after finding sound-on)
-	B_F1 = 4,  ///< found first sound-on
-	B_REV = 8, ///< reading/procssing backwards
-	B_F2 = 16, ///< found last sound-off
-};
 
-struct silan_settings {
-	char *fn;
-	float threshold;
-	enum {PM_SAMPLES, PM_SECONDS, PM_BYTES} printmode;
-	enum {PF_TXT = 0, PF_CSV, PF_JSON, PF_AUDACITY} printformat;
-	float hpf_tc;
-	float holdoff_sec;
-	int progress;
-	char *outfilename;
-	FILE *outfile;
-	int first_last_only;
-	int include_initial;
-};
+/* frames per block when reading backwards, see read_block() */
+#define REV_BLOCKSIZE (PERIODSIZE * 256)
+#define REV_PREROLL   (PERIODSIZE * 4)
 
-struct silan_state {
-	float *hpf_x; // HPF buffer (per channel)
-	float *hpf_y; // HPF buffer (per channel)
-
-	double rms_sum;
-	double *window;
-	double *window_cur;
-	double *window_end;
-	int     window_size;
-
-	int state; // 0: silent, 1:non-silent
-	int64_t holdoff; // holdoff frame counter
-	int64_t prev_on; // frame-number of latest 'On' state - used for delayed print -- audacity only
-	int64_t prev_off; // frame-number of latest 'Off' state - used for delayed print
-	int first_last; // print only first & last
-	int cnt;
-	int64_t initial_silence_countdown;
-};
+/* minimum wall-clock time between checkpoints [sec] */
+#ifndef CHECKPOINT_INTERVAL
+#define CHECKPOINT_INTERVAL (30)
+#endif
+
+/** byte-offset of a frame
+ * @param offset byte-offset of frameno in the file, -1: estimate from the bit-rate
+ */
+static int64_t byte_position(
+		struct adinfo const * const nfo,
+		const int64_t frameno,
+		const int64_t offset) {
+	return offset >= 0 ? offset : frameno * nfo->bit_rate / (8 * nfo->sample_rate);
+}
 
+/** print a timestamp in the selected unit.
+ * @param f file to print to
+ * @param offset byte-offset of frameno in the file, -1: estimate from the bit-rate
+ */
 void print_time(
 		struct silan_settings const * const ss,
+		FILE *f,
 		struct adinfo const * const nfo,
 		const int indent,
-		const int64_t frameno) {
+		const int64_t frameno,
+		const int64_t offset) {
 	switch (ss->printmode) {
 		case PM_SAMPLES:
 			if (indent)
-				fprintf(ss->outfile, "%9"PRIi64, frameno);
+				fprintf(f, "%9"PRIi64, frameno);
 			else
-				fprintf(ss->outfile, "%" PRIi64, frameno);
+				fprintf(f, "%" PRIi64, frameno);
 			break;
 		case PM_BYTES:
 			if (indent)
-				fprintf(ss->outfile, "%9ld", frameno * nfo->bit_rate / (8 * nfo->sample_rate));
+				fprintf(f, "%9ld", (long) byte_position(nfo, frameno, offset));
 			else
-				fprintf(ss->outfile, "%ld", frameno * nfo->bit_rate / (8 * nfo->sample_rate));
+				fprintf(f, "%ld", (long) byte_position(nfo, frameno, offset));
 			break;
 		case PM_SECONDS:
 		default:
 			if (indent)
-				fprintf(ss->outfile, "%7lf", ((double)frameno/nfo->sample_rate) );
+				fprintf(f, "%7lf", ((double)frameno/nfo->sample_rate) );
 			else
-				fprintf(ss->outfile, "%lf", ((double)frameno/nfo->sample_rate) );
+				fprintf(f, "%lf", ((double)frameno/nfo->sample_rate) );
 	}
 }
 
-void format_time(
+/** print an event to one output */
+static void format_event(
 		struct silan_settings const * const ss,
+		struct silan_sink const * const out,
 		struct adinfo const * const nfo,
-		struct silan_state * const st,
-		const int64_t frameno) {
-	switch (ss->printformat) {
+		struct silan_state const * const st,
+		struct silan_format * const fmt,
+		const int64_t frameno,
+		const int64_t offset) {
+	FILE *f = out->outfile;
+	switch (out->printformat) {
 		case PF_TXT:
-			print_time(ss, nfo, 1, frameno);
-			fprintf(ss->outfile, " Sound %s\n", (st->state&1)?"On":"Off");
+			if (st->stream >= 0)
+				fprintf(f, "#%d ", st->stream);
+			print_time(ss, f, nfo, 1, frameno, offset);
+			fprintf(f, " Sound %s\n", (st->state&1)?"On":"Off");
 			break;
 		case PF_JSON:
 			if (st->state&1) {
-				st->prev_on = frameno;
-			} else if (st->prev_on>=0) {
-				if (st->cnt++)
-					fprintf(ss->outfile, ",");
-				fprintf(ss->outfile, " [ ");
-				print_time(ss, nfo, 0, st->prev_on);
-				fprintf(ss->outfile, ", ");
-				print_time(ss, nfo, 0, frameno);
-				fprintf(ss->outfile, " ]");
-				st->prev_on = -1;
+				fmt->prev_on = frameno;
+				fmt->prev_on_offset = offset;
+			} else if (fmt->prev_on>=0) {
+				if (fmt->cnt++)
+					fprintf(f, ",");
+				fprintf(f, " [ ");
+				print_time(ss, f, nfo, 0, fmt->prev_on, fmt->prev_on_offset);
+				fprintf(f, ", ");
+				print_time(ss, f, nfo, 0, frameno, offset);
+				fprintf(f, " ]");
+				fmt->prev_on = -1;
 			}
 			break;
 		case PF_AUDACITY:
 			if (st->state&1) {
-				st->prev_on = frameno;
-			} else if (st->prev_on>=0) {
-				fprintf(ss->outfile, "%7lf\t%lf\tSound\n", (double)st->prev_on/nfo->sample_rate, (double)(frameno)/nfo->sample_rate);
-				st->prev_on = -1;
+				fmt->prev_on = frameno;
+			} else if (fmt->prev_on>=0) {
+				fprintf(f, "%7lf\t%lf\tSound", (double)fmt->prev_on/nfo->sample_rate, (double)(frameno)/nfo->sample_rate);
+				if (st->stream >= 0)
+					fprintf(f, " #%d", st->stream);
+				fprintf(f, "\n");
+				fmt->prev_on = -1;
+			}
+			break;
+		case PF_TEMPLATE:
+			if (st->state&1) {
+				fmt->prev_on = frameno;
+				fmt->prev_on_offset = offset;
+			} else if (fmt->prev_on>=0) {
+				struct silan_range r;
+				r.fn = ss->fn;
+				r.stream = st->stream;
+				r.index = ++fmt->cnt;
+				r.start = fmt->prev_on;
+				r.end = frameno;
+				r.start_byte = byte_position(nfo, fmt->prev_on, fmt->prev_on_offset);
+				r.end_byte = byte_position(nfo, frameno, offset);
+				r.sample_rate = nfo->sample_rate;
+				template_emit(out->tpl, f, &r);
+				fmt->prev_on = -1;
 			}
 			break;
 		default:
 			break;
 	}
-	fflush(ss->outfile);
+	fflush(f);
+}
+
+/** handle an event: track bounds and ranges, print it to all outputs */
+void format_time(
+		struct silan_settings const * const ss,
+		struct adinfo const * const nfo,
+		struct silan_state * const st,
+		const int64_t frameno) {
+	/* overall bounds, see --trim-output */
+	if (st->state & 1) {
+		if (st->first_on < 0 || frameno < st->first_on) st->first_on = frameno;
+	} else if (frameno > st->last_off) {
+		st->last_off = frameno;
+	}
+
+	/* sound ranges, see --split */
+	if (ss->split) {
+		if (st->state & 1) {
+			st->seg_on = frameno;
+		} else if (st->seg_on >= 0) {
+			if (st->n_segments == st->segments_alloc) {
+				const int n = st->segments_alloc ? 2 * st->segments_alloc : 64;
+				int64_t *s = (int64_t*) realloc(st->segments, 2 * n * sizeof(int64_t));
+				if (s) {
+					st->segments = s;
+					st->segments_alloc = n;
+				}
+			}
+			if (st->n_segments < st->segments_alloc) {
+				st->segments[2 * st->n_segments] = st->seg_on;
+				st->segments[2 * st->n_segments + 1] = frameno;
+				st->n_segments++;
+			} else if (debug_level >= 0) {
+				fprintf(stderr, "! out-of-memory, sound range not split.\n");
+			}
+			st->seg_on = -1;
+		}
+	}
+
+	/* position of the packet containing the event, while it is known to the decoder */
+	int k;
+	int want_offset = ss->printmode == PM_BYTES;
+	for (k = 0; k < ss->n_sinks; ++k) {
+		if (ss->sinks[k].printformat == PF_TEMPLATE) want_offset = 1;
+	}
+	const int64_t offset = (want_offset && st->sf) ? ad_byte_offset(st->sf, frameno) : -1;
+	if (want_offset && st->sf && offset < 0 && !st->offset_estimated) {
+		st->offset_estimated = 1;
+		if (debug_level >= 0)
+			fprintf(stderr, "! byte-offset of sample %"PRIi64" is not known, estimated from the bit-rate.\n", frameno);
+	}
+
+	for (k = 0; k < ss->n_sinks; ++k) {
+		format_event(ss, &ss->sinks[k], nfo, st, &st->fmt[k], frameno, offset);
+	}
+}
+
+/* sum of the RMS window, used to periodically replace the running sum,
+ * so that rounding errors of the sliding add/subtract do not accumulate. */
+static double window_sum(float const * const w, const int n) {
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int i;
+	for (i = 0; i + 3 < n; i += 4) {
+		s0 += w[i];
+		s1 += w[i + 1];
+		s2 += w[i + 2];
+		s3 += w[i + 3];
+	}
+	for (; i < n; ++i) {
+		s0 += w[i];
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
+/** update the threshold at the end of a RMS window, see --adaptive.
+ * The fixed threshold is the lower bound, and applies until the
+ * noise-floor is known. */
+static double adaptive_threshold(
+		struct silan_settings const * const ss,
+		struct silan_state * const st,
+		const double rms_sum) {
+	const double t2 = (ss->threshold * ss->threshold) * st->window_size;
+	const double floor = noise_floor_process(st->noise, rms_sum);
+	const double ta = floor * ss->adaptive * ss->adaptive;
+	return ta > t2 ? ta : t2;
+}
+
+#ifdef __GNUC__
+# define ALWAYS_INLINE inline __attribute__((always_inline))
+# define UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+# define ALWAYS_INLINE inline
+# define UNLIKELY(x) (x)
+#endif
+
+/* max channel-count of specialized kernels */
+#define KERNEL_MAX_CHANNELS (8)
+
+/* frames per recorded level, see --relative */
+#define LEVEL_BLOCK (64)
+
+/** hold-state machine, advance by one frame
+ * @param above_threshold signal level of the frame
+ * @param frame frame-number
+ * @param reverse processing backwards (B_REV)
+ * @return 1 if processing should stop (boundary found), 0 otherwise
+ */
+static ALWAYS_INLINE int detector_step(
+		struct silan_settings const * const ss,
+		struct adinfo const * const nfo,
+		struct silan_state * const st,
+		const int above_threshold,
+		const int64_t frame,
+		const int64_t holdoff_threshold,
+		const int reverse
+		) {
+	/* hold state */
+	if (above_threshold) {
+		st->state|=2;
+	} else {
+		st->state&=~2;
+	}
+
+	if (((st->state&1)==1) ^ ((st->state&2)==2)) {
+		if (++st->holdoff >= holdoff_threshold) {
+			st->initial_silence_countdown = -1; // disable
+			if ((st->state&2)) {
+				st->state|=1;
+				st->prev_off = -1;
+			} else {
+				st->state&=~1;
+				st->prev_off = frame + 1 - st->holdoff;
+			}
+			if (!(st->first_last & B_F1)) {
+				format_time(ss, nfo, st, frame + 1 - st->holdoff);
+			}
+			if (reverse) {
+				/* we're reading backwards
+				 * -> sound-start -> beginning of silence (when reading fwd)
+				 */
+				st->state ^= 1;
+				format_time(ss, nfo, st, frame + 1 + st->holdoff);
+				st->state ^= 1;
+				st->first_last |= B_F2;
+				return 1;
+			}
+			if ((st->first_last & B_EN) && (st->state&1) ) {
+				st->first_last |= B_F1;
+				if (st->first_last & B_FAST) {
+					return 1;
+				}
+			}
+		}
+	} else {
+		st->holdoff = 0;
+
+		if (UNLIKELY(st->initial_silence_countdown > 0) && (st->state&1)==0) {
+			if (--st->initial_silence_countdown == 0) {
+				format_time(ss, nfo, st, 0);
+			}
+		}
+	}
+	return 0;
 }
 
-void process_audio(
+/** silence detector, sample by sample
+ *
+ * This is instantiated for common channel-layouts and for forward/reverse
+ * processing, so that the channel loop is unrolled and the direction is
+ * known at compile time (see \ref select_kernel).
+ *
+ * @param nch number of channels, 0: use nfo->channels (generic)
+ * @param reverse process buffer backwards (B_REV)
+ * @param record only record the signal level, see \ref relative_resolve
+ */
+static ALWAYS_INLINE void process_audio_tmpl(
 		struct silan_settings const * const ss,
 		struct adinfo const * const nfo,
 		struct silan_state * const st,
 		const unsigned int n_frames,
 		const int64_t frame_cnt,
-		float const * const buf
+		float const * const buf,
+		const unsigned int nch,
+		const int reverse,
+		const int record
 		) {
 
 	unsigned int i,c;
-	const unsigned int n_channels = nfo->channels;
-	const double t2 = (ss->threshold * ss->threshold) * st->window_size;
+	const unsigned int n_channels = nch ? nch : nfo->channels;
+	double t2 = st->t2;
+	void * const noise = st->noise;
+	int noise_pos = st->noise_pos;
+	int level_pos = st->level_pos;
 	const float a = ss->hpf_tc;
 	const int64_t holdoff_threshold = (ss->holdoff_sec * nfo->sample_rate);
 
-	i = st->first_last & B_REV ? n_frames - 1 : 0;
+	/* keep filter state in registers for specialized kernels */
+	float xs[KERNEL_MAX_CHANNELS], ys[KERNEL_MAX_CHANNELS];
+	float * const hpf_x = nch ? xs : st->hpf_x;
+	float * const hpf_y = nch ? ys : st->hpf_y;
+	float * const window = st->window;
+	float * const window_end = st->window_end;
+	float * window_cur = st->window_cur;
+	double rms_sum = st->rms_sum;
+
+	if (nch) {
+		for (c=0; c < nch; ++c) {
+			xs[c] = st->hpf_x[c];
+			ys[c] = st->hpf_y[c];
+		}
+	}
+
+	i = reverse ? n_frames - 1 : 0;
 	/* process audio sample by sample */
 	while (1) {
 		int above_threshold = 0;
 		for (c=0; c < n_channels; ++c) {
 			/* high pass filter */
 			const float x0 = buf[i * n_channels + c];
-			const float x1 = st->hpf_x[c];
-			const float y1 = st->hpf_y[c];
+			const float x1 = hpf_x[c];
+			const float y1 = hpf_y[c];
 			const float y0 = a * (y1 + x0 - x1);
-			st->hpf_x[c] = x0;
-			st->hpf_y[c] = y0;
+			hpf_x[c] = x0;
+			hpf_y[c] = y0;
 
 			/* calculate RMS */
-			st->rms_sum -= *st->window_cur;
-			*st->window_cur = y0 * y0;
-			st->rms_sum += *st->window_cur;
-
-			st->window_cur++;
-			if (st->window_cur >= st->window_end)
-				st->window_cur = st->window;
+			rms_sum -= *window_cur;
+			*window_cur = y0 * y0;
+			rms_sum += *window_cur;
+
+			window_cur++;
+			if (window_cur >= window_end) {
+				window_cur = window;
+				rms_sum = window_sum(window, st->window_size);
+			}
 
-			if (st->rms_sum > t2)
+			if (rms_sum > t2)
 				above_threshold |=1;
 		}
 
-		/* hold state */
-		if (above_threshold) {
-			st->state|=2;
-		} else {
-			st->state&=~2;
-		}
-
-		if (((st->state&1)==1) ^ ((st->state&2)==2)) {
-			if (++st->holdoff >= holdoff_threshold) {
-				st->initial_silence_countdown = -1; // disable
-				if ((st->state&2)) {
-					st->state|=1;
-					st->prev_off = -1;
-				} else {
-					st->state&=~1;
-					st->prev_off = frame_cnt + i + 1 - st->holdoff;
-				}
-				if (!(st->first_last & B_F1)) {
-					format_time(ss, nfo, st, frame_cnt + i + 1 - st->holdoff);
-				}
-				if (st->first_last & B_REV) {
-					/* we're reading backwards
-					 * -> sound-start -> beginning of silence (when reading fwd)
-					 */
-					st->state ^= 1;
-					format_time(ss, nfo, st, frame_cnt + i + 1 + st->holdoff);
-					st->state ^= 1;
-					st->first_last |= B_F2;
-					break;
-				}
-				if ((st->first_last & B_EN) && (st->state&1) ) {
-					st->first_last |= B_F1;
-					if (st->first_last & B_FAST) {
-						break;
-					}
-				}
+		if (record) {
+			/* the threshold is not yet known, keep the level */
+			if (--level_pos == 0) {
+				level_pos = LEVEL_BLOCK;
+				levels_add(st->levels, rms_sum);
 			}
 		} else {
-			st->holdoff = 0;
+			/* adaptive threshold, once per RMS window */
+			if (UNLIKELY(noise != NULL) && --noise_pos == 0) {
+				noise_pos = st->window_size / n_channels;
+				t2 = adaptive_threshold(ss, st, rms_sum);
+			}
 
-			if (st->initial_silence_countdown > 0 && (st->state&1)==0) {
-				if (--st->initial_silence_countdown == 0) {
-					format_time(ss, nfo, st, 0);
-				}
+			if (detector_step(ss, nfo, st, above_threshold, frame_cnt + i, holdoff_threshold, reverse)) {
+				break;
 			}
 		}
 
 		/* loop: increment or decrement */
-		if (st->first_last & B_REV) {
+		if (reverse) {
 			if (i == 0 ) break;
 			else --i;
 		} else {
@@ -232,19 +418,380 @@ void process_audio(
 			if (i == n_frames) break;
 		}
 	} /* end for each sample */
+
+	if (nch) {
+		for (c=0; c < nch; ++c) {
+			st->hpf_x[c] = xs[c];
+			st->hpf_y[c] = ys[c];
+		}
+	}
+	st->window_cur = window_cur;
+	st->rms_sum = rms_sum;
+	st->t2 = t2;
+	st->noise_pos = noise_pos;
+	st->level_pos = level_pos;
+}
+
+typedef void (*process_fn)(
+		struct silan_settings const * const,
+		struct adinfo const * const,
+		struct silan_state * const,
+		const unsigned int,
+		const int64_t,
+		float const * const);
+
+#define PROCESS_KERNEL(NAME, NCH, REV, REC) \
+static void NAME( \
+		struct silan_settings const * const ss, \
+		struct adinfo const * const nfo, \
+		struct silan_state * const st, \
+		const unsigned int n_frames, \
+		const int64_t frame_cnt, \
+		float const * const buf) { \
+	process_audio_tmpl(ss, nfo, st, n_frames, frame_cnt, buf, NCH, REV, REC); \
+}
+
+PROCESS_KERNEL(process_audio_1_fwd, 1, 0, 0)
+PROCESS_KERNEL(process_audio_1_rev, 1, 1, 0)
+PROCESS_KERNEL(process_audio_1_rec, 1, 0, 1)
+PROCESS_KERNEL(process_audio_2_fwd, 2, 0, 0)
+PROCESS_KERNEL(process_audio_2_rev, 2, 1, 0)
+PROCESS_KERNEL(process_audio_2_rec, 2, 0, 1)
+PROCESS_KERNEL(process_audio_6_fwd, 6, 0, 0)
+PROCESS_KERNEL(process_audio_6_rev, 6, 1, 0)
+PROCESS_KERNEL(process_audio_6_rec, 6, 0, 1)
+PROCESS_KERNEL(process_audio_8_fwd, 8, 0, 0)
+PROCESS_KERNEL(process_audio_8_rev, 8, 1, 0)
+PROCESS_KERNEL(process_audio_8_rec, 8, 0, 1)
+PROCESS_KERNEL(process_audio_n_fwd, 0, 0, 0)
+PROCESS_KERNEL(process_audio_n_rev, 0, 1, 0)
+PROCESS_KERNEL(process_audio_n_rec, 0, 0, 1)
+
+/** pick a detector kernel for the given channel-count and direction
+ * @param record kernel that records the level only, see --relative
+ */
+static process_fn select_kernel(const unsigned int n_channels, const int reverse, const int record) {
+	switch (n_channels) {
+		case 1: return record ? process_audio_1_rec : reverse ? process_audio_1_rev : process_audio_1_fwd;
+		case 2: return record ? process_audio_2_rec : reverse ? process_audio_2_rev : process_audio_2_fwd;
+		case 6: return record ? process_audio_6_rec : reverse ? process_audio_6_rev : process_audio_6_fwd;
+		case 8: return record ? process_audio_8_rec : reverse ? process_audio_8_rev : process_audio_8_fwd;
+		default: break;
+	}
+	return record ? process_audio_n_rec : reverse ? process_audio_n_rev : process_audio_n_fwd;
+}
+
+/** resolve the events of a --relative analysis.
+ * The threshold is derived from the recorded levels, the detector
+ * replays their envelope. Frames between the envelope's values are
+ * interpolated, blocks that do not change the state are skipped.
+ * @param n_frames number of frames that were processed
+ */
+static void relative_resolve(
+		struct silan_settings const * const ss,
+		struct adinfo const * const nfo,
+		struct silan_state * const st,
+		const int64_t n_frames) {
+	const int64_t holdoff_threshold = (ss->holdoff_sec * nfo->sample_rate);
+	const double t_abs = (ss->threshold * ss->threshold) * st->window_size;
+	float const *e;
+	int64_t n, k;
+	int span;
+
+	/* the last, partial block */
+	if (st->level_pos < LEVEL_BLOCK) {
+		levels_add(st->levels, st->rms_sum);
+	}
+	e = levels_data(st->levels, &n, &span);
+
+	const double ref = levels_reference(st->levels, ss->relative_peak);
+	const double t2 = ref * ss->relative * ss->relative > t_abs ? ref * ss->relative * ss->relative : t_abs;
+	if (debug_level > 0) {
+		fprintf(stderr, "Info: %s %.2fdBFS, threshold %.2fdBFS\n",
+				ss->relative_peak ? "peak" : "loudness",
+				10 * log10(ref / st->window_size + 1e-20), 10 * log10(t2 / st->window_size));
+	}
+
+	/* frames per value */
+	const int64_t block = (int64_t) span * LEVEL_BLOCK;
+
+	for (k = 0; k < n; ++k) {
+		const int64_t f0 = k * block;
+		const int64_t len = n_frames - f0 < block ? n_frames - f0 : block;
+		const double v0 = k > 0 ? e[k - 1] : 0;
+		const double v1 = e[k];
+		const int above = v1 > t2;
+		int64_t j;
+
+		if (len <= 0) break;
+
+		/* interpolation is monotonic, the first and the last frame are on
+		 * the same side of the threshold: skip if the state is settled */
+		if (((v0 + (v1 - v0) / len > t2) == above)
+				&& ((st->state & 1) == above) && st->holdoff == 0
+				&& !(st->initial_silence_countdown > 0 && !above)) {
+			st->state = above ? (st->state | 2) : (st->state & ~2);
+			continue;
+		}
+		for (j = 0; j < len; ++j) {
+			detector_step(ss, nfo, st, v0 + (v1 - v0) * (j + 1) / len > t2, f0 + j, holdoff_threshold, 0);
+		}
+	}
 }
 
-static void reset_state(struct silan_state * const st, int nch) {
+static void reset_state(struct silan_settings const * const s, struct silan_state * const st, int nch) {
+		int k;
 		st->holdoff = 0;
 		st->state = 0;
 		st->rms_sum = 0;
-		st->prev_on = -1;
+		for (k = 0; k < s->n_sinks; ++k) {
+			st->fmt[k].prev_on = -1;
+		}
 		st->prev_off = -1;
 		memset(st->hpf_x, 0, nch * sizeof(float));
 		memset(st->hpf_y, 0, nch * sizeof(float));
-		memset(st->window, 0, st->window_size * sizeof(double));
+		memset(st->window, 0, st->window_size * sizeof(float));
 		st->window_cur = st->window;
 		st->window_end = st->window + (st->window_size);
+		st->noise_pos = st->window_size / nch;
+}
+
+/** allocate and initialize detector state for the given file/stream
+ * @return 0 on success, -1 if out of memory
+ */
+static int init_state(
+		struct silan_settings const * const s,
+		struct adinfo const * const nfo,
+		struct silan_state * const st) {
+	int k;
+	st->holdoff = 0;
+	st->state = 0; // start silent
+	st->initial_silence_countdown = s->include_initial ? (s->holdoff_sec * nfo->sample_rate) : 0;
+	st->window_size = nfo->channels * nfo->sample_rate / 50;
+
+	/* a single block: hpf_x[channels], hpf_y[channels], window[window_size] */
+	st->hpf_x = (float*) ad_pool_calloc(2 * nfo->channels + st->window_size, sizeof(float));
+	st->hpf_y = st->hpf_x ? st->hpf_x + nfo->channels : NULL;
+	st->window = st->hpf_x ? st->hpf_x + 2 * nfo->channels : NULL;
+	st->window_cur = st->window;
+	st->window_end = st->window + (st->window_size);
+	st->rms_sum = 0;
+	st->t2 = (s->threshold * s->threshold) * st->window_size;
+	st->noise = s->adaptive > 0 ? noise_floor_open(s->noise_window * 50) : NULL;
+	st->noise_pos = st->window_size / nfo->channels;
+	/* absolute gate -70dBFS */
+	st->levels = s->relative > 0 ? levels_open(1e-7 * st->window_size) : NULL;
+	st->level_pos = LEVEL_BLOCK;
+	st->fmt = (struct silan_format*) calloc(s->n_sinks, sizeof(struct silan_format));
+	for (k = 0; st->fmt && k < s->n_sinks; ++k) {
+		st->fmt[k].prev_on = -1;
+		st->fmt[k].prev_on_offset = -1;
+	}
+	st->prev_off = -1;
+	st->first_last = s->first_last_only & (B_EN|B_FAST);
+	st->stream = -1;
+	st->first_on = -1;
+	st->last_off = -1;
+	st->sf = NULL;
+	st->offset_estimated = 0;
+	st->seg_on = -1;
+	st->segments = NULL;
+	st->n_segments = st->segments_alloc = 0;
+
+	if (!st->hpf_x || !st->hpf_y || !st->window || !st->fmt || (s->adaptive > 0 && !st->noise) || (s->relative > 0 && !st->levels)) {
+		return -1;
+	}
+	return 0;
+}
+
+static void free_state(struct silan_state * const st) {
+	ad_pool_free(st->hpf_x);
+	st->hpf_x = st->hpf_y = st->window = NULL;
+	noise_floor_close(st->noise);
+	st->noise = NULL;
+	levels_close(st->levels);
+	st->levels = NULL;
+	free(st->fmt);
+	st->fmt = NULL;
+	free(st->segments);
+	st->segments = NULL;
+	st->n_segments = st->segments_alloc = 0;
+}
+
+/** file-name for the given --split segment.
+ * The pattern has a single %d conversion, optionally with a width
+ * (e.g. "part-%03d.wav"), "%%" is a literal '%'.
+ * @return 0 on success, -1 if the pattern is invalid or the name too long
+ */
+static int split_filename(char *buf, size_t len, const char *pattern, int idx) {
+	size_t o = 0;
+	int n_conv = 0;
+	const char *p;
+	for (p = pattern; *p; ++p) {
+		if (*p != '%' || p[1] == '%') {
+			if (o + 1 < len) buf[o] = *p;
+			++o;
+			if (*p == '%') ++p;
+			continue;
+		}
+		const char *q = p + 1;
+		int width = 0, zero = 0;
+		if (*q == '0') { zero = 1; ++q; }
+		while (*q >= '0' && *q <= '9' && width < 100) width = width * 10 + (*q++ - '0');
+		if (*q != 'd' || width > 32 || n_conv++) return -1;
+		const int w = snprintf(o < len ? buf + o : NULL, o < len ? len - o : 0, zero ? "%0*d" : "%*d", width, idx);
+		if (w < 0) return -1;
+		o += w;
+		p = q;
+	}
+	if (o >= len || n_conv != 1) return -1;
+	buf[o] = '\0';
+	return 0;
+}
+
+/* write every sound range to its own file, in a single pass */
+static int split_write(
+		struct silan_settings const * const s,
+		void *sf,
+		struct silan_state const * const st) {
+	const int n = st->n_segments;
+	char **fn;
+	int64_t *start, *end;
+	int i, rv = -1;
+
+	if (n < 1) return 0;
+	fn = (char**) calloc(n, sizeof(char*));
+	start = (int64_t*) malloc(n * sizeof(int64_t));
+	end = (int64_t*) malloc(n * sizeof(int64_t));
+	if (!fn || !start || !end) goto out;
+	for (i = 0; i < n; ++i) {
+		char buf[4096];
+		if (split_filename(buf, sizeof(buf), s->split, i + 1) || !(fn[i] = strdup(buf))) goto out;
+		start[i] = st->segments[2 * i];
+		end[i] = st->segments[2 * i + 1];
+	}
+	rv = ad_copy_ranges(sf, (const char * const *) fn, start, end, n);
+	if (rv == 0 && debug_level > 0) {
+		fprintf(stderr, "Wrote %d segment(s)\n", n);
+	}
+
+out:
+	if (fn) for (i = 0; i < n; ++i) free(fn[i]);
+	free(fn);
+	free(start);
+	free(end);
+	return rv;
+}
+
+/* print pending labels at the end of the file */
+static void close_labels(
+		struct silan_settings const * const s,
+		struct adinfo const * const nfo,
+		struct silan_state * const st) {
+	if ((st->state & 1) && !(st->first_last & B_REV)) {
+		/* close off combined on/off labels */
+		st->state = 0;
+		format_time(s, nfo, st, nfo->frames);
+	} else if ((st->first_last & (B_F1|B_F2)) == B_F1) {
+		/* close off first/last only */
+		st->state = 0;
+		format_time(s, nfo, st, st->prev_off >=0 ? st->prev_off : nfo->frames);
+	}
+}
+
+/** byte-offset of the end of the audio, for PM_BYTES.
+ * @param sf decoder handle to query, may be NULL
+ * @return the decoder's offset, else the file size, -1: estimate from the bit-rate
+ */
+static int64_t end_position(void *sf, const char *fn, const int64_t frames) {
+	struct stat fs;
+	int64_t rv = sf ? ad_byte_offset(sf, frames) : -1;
+	if (rv < 0 && fn && !stat(fn, &fs) && S_ISREG(fs.st_mode)) {
+		rv = fs.st_size;
+	}
+	return rv;
+}
+
+/* JSON file properties, following the list of sound ranges
+ * @param end_offset byte-offset of the end of the audio, see \ref end_position
+ * @param analysis --analyze report to include, may be NULL
+ */
+static void print_json_info(
+		struct silan_settings const * const s,
+		FILE *f,
+		struct adinfo const * const nfo,
+		const int64_t end_offset,
+		void *analysis) {
+	fprintf(f, "], \"file duration\":");
+	print_time(s, f, nfo, 0, nfo->frames, end_offset);
+	fprintf(f, ", \"sample rate\":%d", nfo->sample_rate);
+	analyze_report(analysis, f, 1);
+	fprintf(f, "}");
+}
+
+static void print_json_string(FILE *f, const char *str) {
+	fputc('"', f);
+	for (; *str; ++str) {
+		const unsigned char c = *str;
+		if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+		else if (c < 0x20) fprintf(f, "\\u%04x", c);
+		else fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+/* output header, identifies the file in multi-file runs */
+static void print_file_header(struct silan_settings const * const s, struct silan_sink const * const out) {
+	switch (out->printformat) {
+		case PF_JSON:
+			fprintf(out->outfile, "{ ");
+			if (s->n_files > 1) {
+				fprintf(out->outfile, "\"file\":");
+				print_json_string(out->outfile, s->fn);
+				fprintf(out->outfile, ", ");
+			}
+			break;
+		case PF_TXT:
+			if (s->n_files > 1) {
+				fprintf(out->outfile, "# %s\n", s->fn);
+			}
+		default:
+			break;
+	}
+}
+
+/** read a block of audio for reverse processing (--fastbounds).
+ *
+ * Seeking is expensive with compressed formats (container seek, decoder
+ * flush), so the file is read backwards in large blocks: one seek per
+ * block, decoding forward. Data preceding the block is decoded and
+ * discarded (pre-roll) for codecs that need to settle after a seek.
+ *
+ * Blocks are not cached: each is analyzed once. The pre-roll is the only
+ * data that is decoded twice (again as the end of the next lower block),
+ * it cannot be kept since it was decoded before the codec settled.
+ *
+ * @param buf must hold REV_BLOCKSIZE frames
+ * @return number of frames read, -1 on error
+ */
+static int64_t read_block(void *sf, float *buf, const unsigned int nch, const int64_t start, const int64_t n_frames) {
+	int64_t preroll = start > REV_PREROLL ? REV_PREROLL : start;
+	int64_t got = 0;
+
+	if (ad_seek(sf, start - preroll) < 0) {
+		return -1;
+	}
+	while (preroll > 0) {
+		const int rv = ad_read(sf, buf, (preroll > REV_BLOCKSIZE ? REV_BLOCKSIZE : preroll) * nch);
+		if (rv < 1) return -1;
+		preroll -= rv / nch;
+	}
+	while (got < n_frames) {
+		const int rv = ad_read(sf, buf + got * nch, (n_frames - got) * nch);
+		if (rv < 1) break;
+		got += rv / nch;
+	}
+	return got;
 }
 
 int doit(struct silan_settings const * const s) {
@@ -252,10 +799,22 @@ int doit(struct silan_settings const * const s) {
 	struct adinfo nfo;
 	struct silan_state state;
 	int64_t frame_cnt = 0;
+	int resumed = 0;
+	int k;
+	time_t last_checkpoint = time(NULL);
+	void *follow = NULL;
+	process_fn process_audio;
+	int refreshed = 0;
+	int follow_done = 0;
 	float * abuf = NULL;
+	float * rbuf = NULL;
+	void *progress = NULL;
+	void *analysis = NULL;
 	ad_clear_nfo(&nfo);
+	memset(&state, 0, sizeof(struct silan_state));
 
-	void *sf = ad_open(s->fn, &nfo);
+	/* "-": read from stdin, the format is probed */
+	void *sf = strcmp(s->fn, "-") ? ad_open(s->fn, &nfo) : ad_open_fd(STDIN_FILENO, &nfo);
 	if (!sf) {
 		if (debug_level>=0)
 			fprintf(stderr, "! cannot open audio file '%s'\n", s->fn);
@@ -263,46 +822,103 @@ int doit(struct silan_settings const * const s) {
 	}
 
 	ad_dump_nfo(1, &nfo);
-	abuf = (float*) malloc(PERIODSIZE * nfo.channels * sizeof(float));
-
-	state.holdoff = 0;
-	state.cnt = 0;
-	state.state = 0; // start silent
-	state.initial_silence_countdown = s->include_initial ? (s->holdoff_sec * nfo.sample_rate) : 0;
-	state.hpf_x = (float*) calloc(nfo.channels, sizeof(float));
-	state.hpf_y = (float*) calloc(nfo.channels, sizeof(float));
-
-	state.window_size = nfo.channels * nfo.sample_rate / 50;
-	state.window = (double*) calloc(state.window_size, sizeof(double));
-	state.window_cur = state.window;
-	state.window_end = state.window + (state.window_size);
-	state.rms_sum = 0;
-	state.prev_on = -1;
-	state.prev_off = -1;
-	state.first_last = s->first_last_only & (B_EN|B_FAST);
-
-
-	if (!abuf || ! state.hpf_x || ! state.hpf_y || !state.window) {
+	abuf = (float*) ad_pool_alloc(PERIODSIZE * nfo.channels * sizeof(float));
+
+	if (!abuf || init_state(s, &nfo, &state)) {
 		if (debug_level>=0)
 			fprintf(stderr, "! out-of-memory\n");
 		rv=1;
 		goto bailout;
 	}
+	state.sf = sf;
+
+	if (debug_level > 1) {
+		size_t in_use;
+		ad_pool_stats(&in_use, NULL);
+		fprintf(stderr, "Memory: %lu bytes decoder and detector state\n", (unsigned long) in_use);
+	}
+
+	if (s->checkpoint && s->resume) {
+		int64_t out_offset = 0;
+		switch (checkpoint_load(s, &nfo, &state, &frame_cnt, &out_offset)) {
+			case 0:
+				if (ad_seek(sf, frame_cnt) != frame_cnt) {
+					if (debug_level>=0)
+						fprintf(stderr, "! cannot seek to checkpoint position.\n");
+					rv=1;
+					goto bailout;
+				}
+				resumed = 1;
+				break;
+			case 1:
+				/* no checkpoint, start from the beginning */
+				out_offset = 0;
+				break;
+			default:
+				rv=1;
+				goto bailout;
+		}
+		/* discard output written after the checkpoint (single output) */
+		FILE *out = s->sinks[0].outfile;
+		if (s->sinks[0].outfilename && out_offset >= 0) {
+			fflush(out);
+			if (ftruncate(fileno(out), out_offset) || fseeko(out, out_offset, SEEK_SET)) {
+				if (debug_level>=0)
+					fprintf(stderr, "! cannot truncate output file to checkpoint position.\n");
+				rv=1;
+				goto bailout;
+			}
+		}
+		if (resumed && debug_level > 0) {
+			fprintf(stderr, "Resuming at frame %"PRIi64"\n", frame_cnt);
+		}
+	}
 
 	/* output prefixes - if any */
-	switch (s->printformat) {
-		case PF_JSON:
-			fprintf(s->outfile, "{ \"sound\":[");
-		default:
-			break;
+	for (k = 0; k < s->n_sinks && !resumed; ++k) {
+		print_file_header(s, &s->sinks[k]);
+		switch (s->sinks[k].printformat) {
+			case PF_JSON:
+				fprintf(s->sinks[k].outfile, "\"sound\":[");
+			default:
+				break;
+		}
+	}
+
+	if (s->follow) {
+		follow = follow_open(s->fn);
 	}
 
+	progress = progress_open(s, frame_cnt);
+
+	/* stages that analyze the same data as the silence detection */
+	if ((s->envelope || s->analyze) && !(analysis = analyze_open(s, &nfo))) {
+		rv=1;
+		goto bailout;
+	}
+
+	process_audio = select_kernel(nfo.channels, state.first_last & B_REV, state.levels != NULL);
+
 	/* process audio file data */
 	while (1) {
 		int rv = ad_read(sf, abuf, PERIODSIZE * nfo.channels);
-		if (rv < 1) break;
+		if (rv < 1) {
+			if (!follow) break;
+			/* follow mode: check for appended data, or wait for the file to change */
+			if (!refreshed) {
+				refreshed = 1;
+				ad_refresh(sf, &nfo);
+				continue;
+			}
+			if (follow_done) break;
+			follow_done = follow_wait(follow);
+			refreshed = 0;
+			continue;
+		}
+		refreshed = 0;
 
 		process_audio(s, &nfo, &state, rv / nfo.channels, frame_cnt, abuf);
+		analyze_process(analysis, abuf, rv / nfo.channels);
 
 		if ((state.first_last & (B_EN|B_FAST|B_F1)) == (B_EN|B_FAST|B_F1)) {
 			/* first boundary found -- continue decoding backwards from end */
@@ -311,50 +927,66 @@ int doit(struct silan_settings const * const s) {
 
 		frame_cnt += rv / nfo.channels;
 
-		if (s->progress) {
-			fprintf(stderr, " %3.1f%%     \r", frame_cnt * 100.0 / nfo.frames); fflush(stderr);
+		progress_update(progress, frame_cnt, nfo.frames);
+
+		if (s->checkpoint && time(NULL) - last_checkpoint >= CHECKPOINT_INTERVAL) {
+			checkpoint_save(s, &nfo, &state, frame_cnt);
+			last_checkpoint = time(NULL);
 		}
 	}
 
+	if (follow) {
+		/* the total length is only known after the writer finished */
+		follow_close(follow);
+		nfo.frames = frame_cnt;
+	}
+
 	if ((state.first_last & (B_EN|B_FAST|B_F1)) == (B_EN|B_FAST|B_F1)) {
 		/* reset state  - prepare for backwards reading */
 		state.first_last |= B_REV;
-		reset_state(&state, nfo.channels);
-
-		int64_t pos = nfo.frames - PERIODSIZE;
-		/* read audio file backwards from last frame */
-		while (1) {
-			if (pos > 0 && pos < frame_cnt) {
-
-			}
-			if (pos < 0 || pos < frame_cnt || ad_seek(sf, pos) < 0) {
-				break;
-			}
+		reset_state(s, &state, nfo.channels);
+		process_audio = select_kernel(nfo.channels, state.first_last & B_REV, 0);
+
+		/* read audio file backwards from last frame, in large blocks.
+		 * The lowest frame to analyze is aligned to PERIODSIZE from the end,
+		 * so that results do not depend on the block-size */
+		const int64_t lo = frame_cnt > 0 ? frame_cnt : 0;
+		const int64_t end = nfo.frames > lo ? nfo.frames - PERIODSIZE * ((nfo.frames - lo) / PERIODSIZE) : nfo.frames;
+		int64_t pos = nfo.frames;
+
+		rbuf = (float*) ad_pool_alloc(REV_BLOCKSIZE * nfo.channels * sizeof(float));
+		if (!rbuf) {
+			if (debug_level>=0)
+				fprintf(stderr, "! out-of-memory\n");
+			rv=1;
+			goto bailout;
+		}
 
-			int rv = ad_read(sf, abuf, PERIODSIZE * nfo.channels);
-			if (rv < 1) {
+		while (pos > end) {
+			const int64_t start = pos - REV_BLOCKSIZE > end ? pos - REV_BLOCKSIZE : end;
+			const int64_t n = read_block(sf, rbuf, nfo.channels, start, pos - start);
+			if (n < 1) {
 				break;
 			}
 
-			process_audio(s, &nfo, &state, rv / nfo.channels, pos, abuf);
-			pos -= rv / nfo.channels;
+			process_audio(s, &nfo, &state, n, start, rbuf);
+			pos = start;
 
 			if ((state.first_last & B_F2)) {
-				rv = 0;
 				break;
 			}
-		if (s->progress) {
-			fprintf(stderr, " ???.?f%%     \r"); fflush(stderr);
-		}
+			/* the reverse scan ends at frame_cnt at the latest */
+			progress_update(progress, frame_cnt + nfo.frames - pos, nfo.frames);
 		}
 	}
 
 	if (((state.first_last & B_F2) && ((state.state&1) == 0))
 			|| (state.first_last & (B_F2|B_REV)) == B_REV ) {
 		/* reverse decoding failed */
-		reset_state(&state, nfo.channels);
+		reset_state(s, &state, nfo.channels);
 		state.first_last &= ~B_EN;
 		state.state = 1;
+		process_audio = select_kernel(nfo.channels, state.first_last & B_REV, 0);
 
 		/* resume forward decoding from where we left off */
 		if (ad_seek(sf, frame_cnt) < 0) {
@@ -375,46 +1007,238 @@ int doit(struct silan_settings const * const s) {
 
 			frame_cnt += rv / nfo.channels;
 
-			if (s->progress) {
-				fprintf(stderr, " %3.1f%%     \r", frame_cnt * 100.0 / nfo.frames); fflush(stderr);
-			}
+			progress_update(progress, frame_cnt, nfo.frames);
 		}
 	}
 
-	if ((state.state & 1) && !(state.first_last & B_REV)) {
-		/* close off combined on/off labels */
-		state.state = 0;
-		format_time(s, &nfo, &state, nfo.frames);
-	} else if ((state.first_last & (B_F1|B_F2)) == B_F1) {
-		/* close off first/last only */
-		state.state = 0;
-		format_time(s, &nfo, &state, state.prev_off >=0 ? state.prev_off : nfo.frames);
+	if (state.levels) {
+		relative_resolve(s, &nfo, &state, frame_cnt);
 	}
 
-	/* output postfixes - if any */
-	switch (s->printformat) {
-		case PF_JSON:
-			fprintf(s->outfile, "], \"file duration\":");
-			print_time(s, &nfo, 0, nfo.frames);
-			fprintf(s->outfile, ", \"sample rate\":%d", nfo.sample_rate);
-			fprintf(s->outfile, "}\n");
-		default:
-			break;
+	close_labels(s, &nfo, &state);
+
+	/* write the audio between the first and last sound */
+	if (s->trim_output) {
+		const int64_t start = state.first_on >= 0 ? state.first_on : 0;
+		const int64_t end = state.last_off > start ? state.last_off : (state.first_on >= 0 ? nfo.frames : 0);
+		if (ad_copy(sf, s->trim_output, start, end)) {
+			if (debug_level>=0)
+				fprintf(stderr, "! cannot write trimmed audio to '%s'\n", s->trim_output);
+			rv=1;
+		}
 	}
 
-	if (s->progress) {
-		fprintf(stderr,"        \n");
+	if (s->split && split_write(s, sf, &state)) {
+		if (debug_level>=0)
+			fprintf(stderr, "! cannot write split segments to '%s'\n", s->split);
+		rv=1;
 	}
 
+	/* output postfixes - if any */
+	for (k = 0; k < s->n_sinks; ++k) {
+		switch (s->sinks[k].printformat) {
+			case PF_TXT:
+				analyze_report(analysis, s->sinks[k].outfile, 0);
+				break;
+			case PF_JSON:
+				print_json_info(s, s->sinks[k].outfile, &nfo,
+						s->printmode == PM_BYTES ? end_position(sf, s->fn, nfo.frames) : -1, analysis);
+				fprintf(s->sinks[k].outfile, "\n");
+			default:
+				break;
+		}
+	}
+
+	progress_close(progress, 1);
+	progress = NULL;
+
+	analyze_close(analysis);
+	analysis = NULL;
+
 	if (debug_level > 1 &&  frame_cnt != nfo.frames) {
 		fprintf(stderr, "Note: frame-count mismatch: %"PRIi64"/%"PRIi64"\n", frame_cnt, nfo.frames);
 	}
 
+	/* analysis is complete, a checkpoint is no longer useful */
+	checkpoint_remove(s);
+
+bailout:
+	progress_close(progress, 0);
+	analyze_close(analysis);
+	ad_pool_free(abuf);
+	ad_pool_free(rbuf);
+	free_state(&state);
+
+	ad_close(sf);
+	ad_free_nfo(&nfo);
+	return rv;
+}
+
+/** analyze all audio streams of a container in a single pass.
+ *
+ * Every stream has its own detector state, packets are decoded
+ * in file order and dispatched to the stream they belong to.
+ * Events are tagged with the container's stream-index.
+ */
+int doit_streams(struct silan_settings const * const s) {
+	int rv = 0;
+	int i, k, n_streams = 0;
+	unsigned int max_channels = 0;
+	struct adinfo nfo;
+	struct adinfo *snfo = NULL;
+	struct silan_state *state = NULL;
+	struct silan_settings *sset = NULL;
+	struct silan_sink *sinks = NULL;
+	int *index = NULL;
+	int64_t *frame_cnt = NULL;
+	int64_t total = 0, done = 0;
+	float * abuf = NULL;
+	void *progress = NULL;
+	ad_clear_nfo(&nfo);
+
+	void *sf = ad_open(s->fn, &nfo);
+	if (!sf) {
+		if (debug_level>=0)
+			fprintf(stderr, "! cannot open audio file '%s'\n", s->fn);
+		return 1;
+	}
+
+	n_streams = ad_streams(sf, NULL, NULL, 0);
+	if (n_streams < 1) {
+		if (debug_level>=0)
+			fprintf(stderr, "! no decodable audio stream in '%s'\n", s->fn);
+		n_streams = 0;
+		rv=1;
+		goto bailout;
+	}
+
+	snfo = (struct adinfo*) calloc(n_streams, sizeof(struct adinfo));
+	state = (struct silan_state*) calloc(n_streams, sizeof(struct silan_state));
+	sset = (struct silan_settings*) calloc(n_streams, sizeof(struct silan_settings));
+	sinks = (struct silan_sink*) calloc(n_streams * s->n_sinks, sizeof(struct silan_sink));
+	index = (int*) calloc(n_streams, sizeof(int));
+	frame_cnt = (int64_t*) calloc(n_streams, sizeof(int64_t));
+
+	if (!snfo || !state || !sset || !sinks || !index || !frame_cnt) {
+		if (debug_level>=0)
+			fprintf(stderr, "! out-of-memory\n");
+		n_streams = 0;
+		rv=1;
+		goto bailout;
+	}
+
+	ad_streams(sf, snfo, index, n_streams);
+
+	for (i = 0; i < n_streams; ++i) {
+		sset[i] = *s;
+		sset[i].sinks = &sinks[i * s->n_sinks];
+		if (init_state(s, &snfo[i], &state[i])) {
+			if (debug_level>=0)
+				fprintf(stderr, "! out-of-memory\n");
+			rv=1;
+			goto bailout;
+		}
+		state[i].stream = index[i];
+		for (k = 0; k < s->n_sinks; ++k) {
+			sset[i].sinks[k] = s->sinks[k];
+			if (s->sinks[k].printformat != PF_JSON) continue;
+			/* collect per stream, events of streams are interleaved */
+			if (!(sset[i].sinks[k].outfile = tmpfile())) {
+				if (debug_level>=0)
+					fprintf(stderr, "! cannot create temporary file\n");
+				rv=1;
+				goto bailout;
+			}
+		}
+		if (snfo[i].channels > max_channels) max_channels = snfo[i].channels;
+		total += snfo[i].frames;
+		if (debug_level > 0)
+			fprintf(stderr, "Stream #%d: %u channels, %u Hz\n", index[i], snfo[i].channels, snfo[i].sample_rate);
+	}
+
+	abuf = (float*) ad_pool_alloc(PERIODSIZE * max_channels * sizeof(float));
+	if (!abuf) {
+		if (debug_level>=0)
+			fprintf(stderr, "! out-of-memory\n");
+		rv=1;
+		goto bailout;
+	}
+
+	progress = progress_open(s, 0);
+
+	/* JSON is assembled after analysis, text is printed as it goes */
+	for (k = 0; k < s->n_sinks; ++k) {
+		if (s->sinks[k].printformat != PF_JSON) {
+			print_file_header(s, &s->sinks[k]);
+		}
+	}
+
+	/* process audio file data */
+	while (1) {
+		int k = 0;
+		ssize_t rv = ad_read_stream(sf, abuf, PERIODSIZE * max_channels, &k);
+		if (rv < 1 || k < 0 || k >= n_streams) break;
+
+		const unsigned int n_frames = rv / snfo[k].channels;
+		select_kernel(snfo[k].channels, 0, state[k].levels != NULL)(&sset[k], &snfo[k], &state[k], n_frames, frame_cnt[k], abuf);
+		frame_cnt[k] += n_frames;
+		done += n_frames;
+
+		progress_update(progress, done, total);
+	}
+
+	for (i = 0; i < n_streams; ++i) {
+		/* container durations are approximate, use the decoded length */
+		snfo[i].frames = frame_cnt[i];
+		if (state[i].levels) {
+			relative_resolve(&sset[i], &snfo[i], &state[i], frame_cnt[i]);
+		}
+		close_labels(&sset[i], &snfo[i], &state[i]);
+	}
+
+	/* output */
+	for (k = 0; k < s->n_sinks; ++k) {
+		char buf[BUFSIZ];
+		size_t n;
+		FILE *out = s->sinks[k].outfile;
+		if (s->sinks[k].printformat != PF_JSON) continue;
+		print_file_header(s, &s->sinks[k]);
+		fprintf(out, "\"streams\":[");
+		for (i = 0; i < n_streams; ++i) {
+			FILE *tmp = sset[i].sinks[k].outfile;
+			fprintf(out, "%s{ \"stream\":%d, \"sound\":[", i ? ", " : "", index[i]);
+			rewind(tmp);
+			while ((n = fread(buf, 1, sizeof(buf), tmp)) > 0) {
+				fwrite(buf, 1, n, out);
+			}
+			/* the decoder's positions are those of the first stream */
+			print_json_info(s, out, &snfo[i],
+					s->printmode == PM_BYTES ? end_position(NULL, s->fn, snfo[i].frames) : -1, NULL);
+		}
+		fprintf(out, "]}\n");
+	}
+
+	progress_close(progress, 1);
+	progress = NULL;
+
 bailout:
-	free(abuf);
-	free(state.hpf_x);
-	free(state.hpf_y);
-	free(state.window);
+	progress_close(progress, 0);
+	for (i = 0; i < n_streams; ++i) {
+		for (k = 0; sinks && k < s->n_sinks; ++k) {
+			FILE *tmp = sinks[i * s->n_sinks + k].outfile;
+			if (tmp && tmp != s->sinks[k].outfile) {
+				fclose(tmp);
+			}
+		}
+		free_state(&state[i]);
+	}
+	ad_pool_free(abuf);
+	free(snfo);
+	free(state);
+	free(sset);
+	free(sinks);
+	free(index);
+	free(frame_cnt);
 
 	ad_close(sf);
 	ad_free_nfo(&nfo);
@@ -428,16 +1252,31 @@ bailout:
 
 static struct option const long_options[] =
 {
+	{"adaptive", required_argument, 0, 'a'},
+	{"all-streams", no_argument, 0, 'S'},
+	{"analyze", required_argument, 0, 'A'},
 	{"bounds", no_argument, 0, 'b'},
 	{"fastbounds", no_argument, 0, 'B'},
+	{"envelope", required_argument, 0, 'e'},
+	{"envelope-block", required_argument, 0, 'E'},
+	{"follow", no_argument, 0, 'w'},
+	{"checkpoint", required_argument, 0, 'c'},
 	{"format", required_argument, 0, 'f'},
+	{"format-template", required_argument, 0, 'm'},
 	{"filter", required_argument, 0, 'F'},
 	{"help", no_argument, 0, 'h'},
 	{"initial", no_argument, 0, 'i'},
+	{"noise-window", required_argument, 0, 'N'},
 	{"output", required_argument, 0, 'o'},
 	{"progress", no_argument, 0, 'p'},
+	{"progress-fd", required_argument, 0, 'P'},
 	{"quiet", no_argument, 0, 'q'},
+	{"reference", required_argument, 0, 'L'},
+	{"relative", required_argument, 0, 'R'},
+	{"resume", no_argument, 0, 'r'},
+	{"split", required_argument, 0, 'x'},
 	{"threshold", required_argument, 0, 's'},
+	{"trim-output", required_argument, 0, 'T'},
 	{"holdoff", required_argument, 0, 't'},
 	{"unit", required_argument, 0, 'u'},
 	{"verbose", no_argument, 0, 'v'},
@@ -447,42 +1286,107 @@ static struct option const long_options[] =
 
 static void usage (int status) {
   printf ("silan - Audiofile Silence Analyzer.\n\n");
-  printf ("Usage: silan [ OPTIONS ] <file-name>\n\n");
+  printf ("Usage: silan [ OPTIONS ] <file-name> [<file-name> ...]\n\n");
   printf ("Options:\n\
   -h, --help                 display this help and exit\n\
+  -A, --analyze <list>       also check for clipping, DC offset and peak level,\n\
+                             comma-separated: clip, dc, peak or all\n\
+  -a, --adaptive <float>     threshold relative to the noise-floor (factor,\n\
+                             postfix with 'd' to specify decibels).\n\
+                             --threshold is the lower bound.\n\
   -b, --bounds               skip silence mid file.\n\
 	                           print start/end boundaries only.\n\
   -B, --fastbounds           same as -b, except the sound-off is detected by\n\
 	                           decoding backwards from the end.\n\
 	                           This is much faster but also inacurate.\n\
-  -f, --format <format>      specify output format (default: 'txt')\n\
+  -c, --checkpoint <filename> periodically save the analysis state to the\n\
+                             given file (not available with --fastbounds).\n\
+  -e, --envelope <filename>  also write a peak/RMS envelope (per channel)\n\
+                             to the given file (.json or binary).\n\
+  -E, --envelope-block <int> frames per envelope value (default: 1024)\n\
+  -f, --format <format>      specify output format (default: 'txt'),\n\
+                             can be given once per --output\n\
+  -m, --format-template <template> custom output format, one line per\n\
+                             sound range (used like --format)\n\
   -F, --filter <float>       high-pass filter coefficient (default:0.98)\n\
                              disable: 1.0; range 0 < val <= 1.0\n\
   -i, --include-initial      display initial state (don't assume initial\n\
                              silence at start).\n\
-  -o, --output <filename>    write data to file instead of stdout\n\
+  -N, --noise-window <float> time in seconds to find the noise-floor in,\n\
+                             see --adaptive (default 10)\n\
+  -o, --output <filename>    write data to file instead of stdout,\n\
+                             can be given multiple times\n\
   -p, --progress             show progress info on stderr\n\
+  -P, --progress-fd <fd>     write machine-readable progress (JSON lines) to\n\
+                             the given file-descriptor.\n\
   -q, --quiet                inhibit error messages\n\
+  -R, --relative <float>     threshold relative to the level of the whole\n\
+                             file (factor, postfix with 'd' for decibels\n\
+                             below). --threshold is the lower bound.\n\
+  -L, --reference <level>    level for --relative: 'loudness' (default)\n\
+                             or 'peak'\n\
+  -r, --resume               continue from the --checkpoint file, if it exists.\n\
+  -S, --all-streams          analyze every audio stream of the file in a\n\
+                             single pass, events are tagged with the stream.\n\
   -s, --threshold <float>    RMS signal threshold (default 0.001 ^= -60dB)\n\
                              postfix with 'd' to specify decibels\n\
   -t, --holdoff <float>      holdoff time in seconds (default 0.5)\n\
+  -T, --trim-output <filename> write the audio from the first sound-on to\n\
+                             the last sound-off to the given file.\n\
   -u, --unit <unit>          specify output unit (default: 'seconds')\n\
   -v, --verbose              increase debug-level (can be used multiple times)\n\
   -V, --version              print version information and exit\n\
+  -w, --follow               keep reading as data is appended to the file,\n\
+                             until the writer closes it (or on SIGINT/TERM).\n\
+  -x, --split <pattern>      write every sound range to its own file, the\n\
+                             pattern has a %%d for the number (e.g. part-%%03d.wav)\n\
 \n");
   printf ("\n\
-This application reads a single audio file and analyzes it for\n\
-silent periods. Timestamps/ranges of silence are printed to standard output.\n\
+This application reads audio files and analyzes them for silent\n\
+periods. Timestamps/ranges of silence are printed to standard output.\n\
+When more than one file is given, the files are analyzed one after another:\n\
+text output starts each file with a '# <file-name>' line, JSON output has\n\
+one object per line with an additional \"file\" property.\n\
 \n\
 Valid output formats are: txt, JSON, audacity (label file)\n\
+Several outputs can be written in a single run: the first --format applies\n\
+to the first --output file, the second to the second, and so on. A single\n\
+extra --format is written to standard output, e.g.\n\
+  silan -f json -o db.json -f audacity -o labels.txt -f txt <file>\n\
+\n\
+A --format-template is parsed once and printed for every sound range:\n\
+  %%s, %%e, %%d   start, end and duration in seconds\n\
+  %%S, %%E, %%D   start, end and duration in samples\n\
+  %%b, %%B       start and end byte-offset in the file (see --unit bytes)\n\
+  %%f           file-name\n\
+  %%n           number of the sound range, starting at 1\n\
+  %%c           stream-index (with --all-streams)\n\
+  %%%%           a literal %%; \\n, \\t and \\\\ are newline, tab and backslash\n\
+e.g. silan -m '%%f\\t%%S\\t%%D\\n' <file>\n\
 \n\
 Valid output units are: samples, seconds or bytes (audacity format uses\n\
-seconds regardless).\n\
+seconds regardless). Byte positions are file offsets: of the sample for WAV\n\
+files, of the containing packet for compressed audio. If that is not known\n\
+the position is estimated from the bit-rate.\n\
 \n\
 Sound is detected if the signal level exceeds a given threshold for a\n\
 duration of at least <holdoff> time.\n\
 Note that the returned timestamps are corrected for the holdoff-time.\n\
 \n\
+For recordings with a changing noise-floor, --adaptive sets the threshold\n\
+relative to the RMS of the quietest 20ms block within the last\n\
+--noise-window seconds, e.g. '-a 10d' detects sound 10dB above the noise.\n\
+The fixed threshold applies until a complete noise-window has been\n\
+analyzed and remains the lower bound.\n\
+\n\
+With --relative, the threshold is relative to the level of the complete\n\
+file, e.g. '-R 40d' is 40dB below the program loudness (the gated mean RMS,\n\
+as in ITU-R BS.1770, without K-weighting) or the loudest 20ms (peak).\n\
+The file is decoded once: the RMS level is recorded every 64 samples and\n\
+the events are determined from the recording at the end of the file.\n\
+Memory is bounded: beyond 2^22 levels (93 minutes at 48kHz) the recording\n\
+is kept at a coarser rate, e.g. every 1024 samples for 24 hours at 48kHz.\n\
+\n\
 The fast boundary scan can decrease the time it takes to analyze a file\n\
 at the cost of accuracy.\n\
 Use --fastbounds with care. Due to low-pass filtering and RMS calculation\n\
@@ -491,6 +1395,53 @@ suitable for backwards decoding or sample-accurate seeking and may skew the\n\
 timestamp by one second or more.\n\
 The fast boundary scan mode requires a seekable file and does not work with\n\
 streams.\n\
+Remote files (e.g. http:// URLs) are read by ffmpeg. For http:// and\n\
+https:// URLs, if the server supports range requests, data is fetched in\n\
+large blocks and cached, so that only the decoded parts are transferred:\n\
+with --fastbounds, the head and the tail. The cache uses 1/16 of the file\n\
+size (1 to 32 MiB), the environment variable AD_CACHE_MB sets its size.\n\
+The file-name '-' reads from stdin, e.g. a pipe. The format is detected\n\
+from the data, options that seek in or re-open the file are not available.\n\
+\n\
+An overview of the signal (e.g. for waveform display) can be computed in\n\
+the same pass with --envelope: peak and RMS of every block of frames, for\n\
+each channel. The JSON variant lists [peak, rms, ...] per block, the binary\n\
+variant has a header (\"silanENV\", version, channels, sample-rate,\n\
+block-size as uint32) followed by float peak/rms pairs in host byte-order.\n\
+\n\
+Quality-control checks are done on the same decoded data with --analyze,\n\
+the results are appended to text and JSON output (as \"analysis\" property):\n\
+  clip  runs of 3 or more consecutive samples at full-scale: number of runs,\n\
+        clipped samples, the longest run and the time of the first run\n\
+  dc    mean of every channel\n\
+  peak  sample-peak and true-peak (4x oversampled, as in ITU-R BS.1770)\n\
+        of every channel, in dB for text output\n\
+\n\
+Progress reports on --progress-fd are rate-limited and written one JSON\n\
+object per line: {\"frames\":N, \"total\":N, \"fps\":N, \"eta\":sec}.\n\
+The last line has \"done\":true.\n\
+\n\
+Long analysis runs can be made restartable by specifying a --checkpoint file.\n\
+If the process is interrupted, re-running it with the same settings and\n\
+--resume continues from the last checkpoint with identical results.\n\
+When writing to a file (-o), output after the checkpoint is discarded;\n\
+when writing to stdout, only the remaining output is printed.\n\
+The checkpoint file is removed once the analysis completes.\n\
+\n\
+In follow mode, files that are still being recorded to are analyzed\n\
+incrementally. Events are printed as soon as they are final.\n\
+\n\
+With --trim-output, leading and trailing silence is removed without\n\
+re-encoding: PCM WAV data is copied as-is, other lossless formats are\n\
+written in the same format, and compressed audio is remuxed at packet\n\
+granularity (the container is chosen by the file-name extension).\n\
+--split writes each sound range the same way, numbered from 1. All files\n\
+are written in a single pass over the input, after the analysis.\n\
+\n\
+Containers with multiple audio tracks (e.g. MXF, MOV, MKV) can be analyzed\n\
+with --all-streams. Every audio stream is analyzed separately with the given\n\
+settings. Text and audacity output is prefixed/suffixed with the stream-index\n\
+(#N), JSON output lists the sound ranges per stream.\n\
 \n");
   printf ("Report bugs to Robin Gareus <robin@gareus.org>\n"
           "Website and manual: <https://github.com/x42/silan>\n"
@@ -498,27 +1449,110 @@ streams.\n\
   exit (status);
 }
 
+/** set up outputs: the n-th -f (or -m) is the format of the n-th -o file.
+ * Without -o, or if there is one more -f than -o, the last -f is the
+ * format of standard output. n_f must not exceed n_o + 1.
+ */
+static int init_sinks (struct silan_settings * const ss,
+		int const *formats, void **templates, const int n_f, char **names, const int n_o) {
+	int i;
+	ss->sinks = (struct silan_sink*) calloc(n_o + 1, sizeof(struct silan_sink));
+	if (!ss->sinks) return -1;
+	for (i = 0; i < n_o; ++i) {
+		ss->sinks[i].printformat = i < n_f ? formats[i] : PF_TXT;
+		ss->sinks[i].tpl = i < n_f ? templates[i] : NULL;
+		ss->sinks[i].outfilename = names[i];
+	}
+	ss->n_sinks = n_o;
+	if (n_o == 0 || n_f > n_o) {
+		ss->sinks[n_o].printformat = n_f > 0 ? formats[n_f - 1] : PF_TXT;
+		ss->sinks[n_o].tpl = n_f > 0 ? templates[n_f - 1] : NULL;
+		ss->sinks[n_o].outfilename = NULL;
+		ss->n_sinks++;
+	}
+	return 0;
+}
+
 static int decode_switches (struct silan_settings * const ss, int argc, char **argv) {
 	int c;
+	int n_f = 0, n_o = 0;
+	int *formats = (int*) calloc(argc, sizeof(int));
+	void **templates = (void**) calloc(argc, sizeof(void*));
+	char **names = (char**) calloc(argc, sizeof(char*));
+
+	if (!formats || !templates || !names) {
+		fprintf(stderr, "! out-of-memory\n");
+		exit(EXIT_FAILURE);
+	}
 
 	while ((c = getopt_long (argc, argv,
 			   "h"	/* help */
+			   "a:"	/* adaptive threshold */
+			   "A:"	/* analyzers */
 			   "b" 	/* boundaries */
 			   "B" 	/* boundaries */
+			   "c:"	/* checkpoint */
+			   "e:"	/* envelope */
+			   "E:"	/* envelope block-size */
 			   "f:"	/* output format */
 			   "F:"	/* high-pass filter cutoff */
 			   "i"  /* include-initial */
+			   "L:"	/* relative reference */
+			   "m:"	/* output format template */
+			   "N:"	/* noise window */
 			   "o:" /* outfile */
 			   "p" 	/* progress */
+			   "P:"	/* progress fd */
 			   "s:"	/* signal threhold */
+			   "S" 	/* all streams */
 			   "t:"	/* holdoff time */
+			   "T:"	/* trim output */
 			   "u:"	/* unit */
 			   "q" 	/* quiet */
+			   "r" 	/* resume */
+			   "R:"	/* relative threshold */
 			   "v" 	/* verbose */
-			   "V",	/* version */
+			   "V"	/* version */
+			   "w"	/* follow */
+			   "x:",	/* split */
 			   long_options, (int *) 0)) != EOF) {
 		switch (c)
 		{
+			case 'a':
+				{
+					float v;
+					if (strlen(optarg)> 0 && optarg[strlen(optarg)-1] == 'd') {
+						v = pow(10.0, atof(optarg)/20.0);
+					} else {
+						v = atof(optarg);
+					}
+					if (v > 0) {
+						ss->adaptive = v;
+					} else {
+						fprintf(stderr, "! invalid adaptive threshold.\n");
+						usage(EXIT_FAILURE);
+					}
+				}
+				break;
+
+			case 'A':
+				{
+					char *list = strdup(optarg);
+					char *tok, *sp = NULL;
+					for (tok = strtok_r(list, ",", &sp); tok; tok = strtok_r(NULL, ",", &sp)) {
+						if      (!strncasecmp(tok, "clip", strlen(tok))) ss->analyze |= A_CLIP;
+						else if (!strncasecmp(tok, "dc", strlen(tok))) ss->analyze |= A_DC;
+						else if (!strncasecmp(tok, "peak", strlen(tok))) ss->analyze |= A_PEAK;
+						else if (!strncasecmp(tok, "all", strlen(tok))) ss->analyze |= A_CLIP | A_DC | A_PEAK;
+						else {
+							fprintf(stderr, "! invalid analyzer '%s' specified\n", tok);
+							usage(EXIT_FAILURE);
+						}
+					}
+					free(list);
+				}
+				break;
+
 			case 'b':
 				ss->first_last_only |= B_EN;
 				break;
@@ -527,11 +1561,29 @@ static int decode_switches (struct silan_settings * const ss, int argc, char **a
 				ss->first_last_only |= B_EN | B_FAST;
 				break;
 
+			case 'c':
+				free(ss->checkpoint);
+				ss->checkpoint = strdup(optarg);
+				break;
+
+			case 'e':
+				free(ss->envelope);
+				ss->envelope = strdup(optarg);
+				break;
+
+			case 'E':
+				ss->envelope_block = atoi(optarg);
+				if (ss->envelope_block < 1) {
+					fprintf(stderr, "! invalid envelope block-size.\n");
+					usage(EXIT_FAILURE);
+				}
+				break;
+
 			case 'f':
-				if      (!strncasecmp(optarg, "txt" , strlen(optarg))) ss->printformat = PF_TXT;
-				else if (!strncasecmp(optarg, "text" , strlen(optarg))) ss->printformat = PF_TXT;
-				else if (!strncasecmp(optarg, "json", strlen(optarg))) ss->printformat = PF_JSON;
-				else if (!strncasecmp(optarg, "audacity", strlen(optarg))) ss->printformat = PF_AUDACITY;
+				if      (!strncasecmp(optarg, "txt" , strlen(optarg))) formats[n_f++] = PF_TXT;
+				else if (!strncasecmp(optarg, "text" , strlen(optarg))) formats[n_f++] = PF_TXT;
+				else if (!strncasecmp(optarg, "json", strlen(optarg))) formats[n_f++] = PF_JSON;
+				else if (!strncasecmp(optarg, "audacity", strlen(optarg))) formats[n_f++] = PF_AUDACITY;
 				else {
 					fprintf(stderr, "! invalid output format specified\n");
 					usage(EXIT_FAILURE);
@@ -542,6 +1594,30 @@ static int decode_switches (struct silan_settings * const ss, int argc, char **a
 				ss->include_initial = 1;
 				break;
 
+			case 'm':
+				if (!(templates[n_f] = template_compile(optarg))) {
+					usage(EXIT_FAILURE);
+				}
+				formats[n_f++] = PF_TEMPLATE;
+				break;
+
+			case 'L':
+				if      (!strncasecmp(optarg, "loudness", strlen(optarg))) ss->relative_peak = 0;
+				else if (!strncasecmp(optarg, "peak", strlen(optarg))) ss->relative_peak = 1;
+				else {
+					fprintf(stderr, "! invalid reference level specified\n");
+					usage(EXIT_FAILURE);
+				}
+				break;
+
+			case 'N':
+				ss->noise_window = atof(optarg);
+				if (ss->noise_window < .02) {
+					fprintf(stderr, "! invalid noise-window, need at least 0.02 sec.\n");
+					usage(EXIT_FAILURE);
+				}
+				break;
+
 			case 'u':
 				if      (!strncasecmp(optarg, "samples" , strlen(optarg))) ss->printmode = PM_SAMPLES;
 				else if (!strncasecmp(optarg, "seconds" , strlen(optarg))) ss->printmode = PM_SECONDS;
@@ -561,14 +1637,21 @@ static int decode_switches (struct silan_settings * const ss, int argc, char **a
 				break;
 
 			case 'o':
-				free(ss->outfilename);
-				ss->outfilename = strdup(optarg);
+				names[n_o++] = strdup(optarg);
 				break;
 
 			case 'p':
 				ss->progress = 1;
 				break;
 
+			case 'P':
+				ss->progress_fd = atoi(optarg);
+				if (ss->progress_fd < 0 || fcntl(ss->progress_fd, F_GETFD) < 0) {
+					fprintf(stderr, "! invalid progress file-descriptor.\n");
+					usage(EXIT_FAILURE);
+				}
+				break;
+
 			case 's':
 				{
 					float v;
@@ -596,11 +1679,50 @@ static int decode_switches (struct silan_settings * const ss, int argc, char **a
 				debug_level=-1;
 				break;
 
+			case 'r':
+				ss->resume = 1;
+				break;
+
+			case 'R':
+				{
+					float v;
+					if (strlen(optarg)> 0 && optarg[strlen(optarg)-1] == 'd') {
+						v = pow(10.0, fabsf(atof(optarg))/-20.0);
+					} else {
+						v = atof(optarg);
+					}
+					if (v > 0 && v <= 1) {
+						ss->relative = v;
+					} else {
+						fprintf(stderr, "! invalid relative threshold.\n");
+						usage(EXIT_FAILURE);
+					}
+				}
+				break;
+
+			case 'S':
+				ss->all_streams = 1;
+				break;
+
+			case 'T':
+				free(ss->trim_output);
+				ss->trim_output = strdup(optarg);
+				break;
+
+			case 'x':
+				free(ss->split);
+				ss->split = strdup(optarg);
+				break;
+
 			case 'v':
 				if (debug_level>=0)
 					debug_level++;
 				break;
 
+			case 'w':
+				ss->follow = 1;
+				break;
+
 			case 'V':
 				printf ("silan version %s\n\n", VERSION);
 				printf ("Copyright (C) GPL 2012-2018 Robin Gareus <robin@gareus.org>\n");
@@ -614,26 +1736,53 @@ static int decode_switches (struct silan_settings * const ss, int argc, char **a
 				break;
 		}
 	}
+
+	if (n_f > n_o + 1) {
+		fprintf(stderr, "! %d output formats given for %d output files, at most one format can apply to standard output.\n", n_f, n_o);
+		usage(EXIT_FAILURE);
+	}
+
+	if (init_sinks(ss, formats, templates, n_f, names, n_o)) {
+		fprintf(stderr, "! out-of-memory\n");
+		exit(EXIT_FAILURE);
+	}
+	free(formats);
+	free(templates);
+	free(names);
 	return optind;
 }
 
 
 int main(int argc, char **argv) {
-	int rv = 0;
+	int rv = 0, k;
 	struct silan_settings settings;
 
 	/* default values */
 	settings.printmode = PM_SECONDS;
-	settings.printformat = PF_TXT;
 	settings.threshold = 0.001; //  10^(db/20.0) with db < 0.
 	settings.hpf_tc = .98; // 0..1  == RC / (RC + dt)  // f = 1 / (2 M_PI RC)
 	settings.holdoff_sec = 0.5;
 	settings.fn = NULL;
-	settings.outfile = NULL;
-	settings.outfilename = NULL;
+	settings.sinks = NULL;
+	settings.n_sinks = 0;
 	settings.progress = 0;
+	settings.progress_fd = -1;
 	settings.first_last_only = 0;
 	settings.include_initial = 0;
+	settings.checkpoint = NULL;
+	settings.resume = 0;
+	settings.follow = 0;
+	settings.all_streams = 0;
+	settings.envelope = NULL;
+	settings.trim_output = NULL;
+	settings.split = NULL;
+	settings.envelope_block = 1024;
+	settings.analyze = 0;
+	settings.adaptive = 0;
+	settings.noise_window = 10;
+	settings.relative = 0;
+	settings.relative_peak = 0;
+	settings.n_files = 0;
 
 	/* parse options */
 	int i = decode_switches (&settings, argc, argv);
@@ -641,37 +1790,126 @@ int main(int argc, char **argv) {
 	ad_set_debuglevel(debug_level);
 
 	if (argc > i) {
-		settings.fn = strdup(argv[i]);
+		settings.n_files = argc - i;
 	} else {
 		usage(EXIT_FAILURE);
 	}
 
-	/* open output file - if any */
-	if (settings.outfilename) {
-		settings.outfile = fopen(settings.outfilename, "w");
-		if (!settings.outfile) {
+	if (settings.checkpoint && (settings.first_last_only & B_FAST)) {
+		fprintf(stderr, "! --checkpoint can not be combined with --fastbounds\n");
+		usage(EXIT_FAILURE);
+	}
+	if (settings.follow && (settings.first_last_only & B_FAST)) {
+		fprintf(stderr, "! --follow can not be combined with --fastbounds\n");
+		usage(EXIT_FAILURE);
+	}
+	if (settings.all_streams && (settings.checkpoint || settings.follow || (settings.first_last_only & B_FAST))) {
+		fprintf(stderr, "! --all-streams can not be combined with --checkpoint, --follow or --fastbounds\n");
+		usage(EXIT_FAILURE);
+	}
+	if (settings.envelope && (settings.checkpoint || settings.all_streams || (settings.first_last_only & B_FAST))) {
+		fprintf(stderr, "! --envelope can not be combined with --checkpoint, --all-streams or --fastbounds\n");
+		usage(EXIT_FAILURE);
+	}
+	if (settings.analyze && (settings.checkpoint || settings.all_streams || (settings.first_last_only & B_FAST))) {
+		/* every sample needs to be analyzed, once */
+		fprintf(stderr, "! --analyze can not be combined with --checkpoint, --all-streams or --fastbounds\n");
+		usage(EXIT_FAILURE);
+	}
+	if ((settings.trim_output || settings.split) && (settings.checkpoint || settings.follow || settings.all_streams)) {
+		fprintf(stderr, "! --trim-output and --split can not be combined with --checkpoint, --follow or --all-streams\n");
+		usage(EXIT_FAILURE);
+	}
+	if (settings.split) {
+		char buf[4096];
+		if (split_filename(buf, sizeof(buf), settings.split, 1)) {
+			fprintf(stderr, "! invalid --split pattern, a single %%d conversion is required\n");
+			usage(EXIT_FAILURE);
+		}
+	}
+	if (settings.n_files > 1 && (settings.checkpoint || settings.follow || settings.envelope || settings.trim_output || settings.split)) {
+		fprintf(stderr, "! --checkpoint, --follow, --envelope, --trim-output and --split can only be used with a single file\n");
+		usage(EXIT_FAILURE);
+	}
+	for (k = 0; k < settings.n_sinks; ++k) {
+		if (settings.n_files > 1 && settings.sinks[k].printformat == PF_AUDACITY) {
+			fprintf(stderr, "! audacity label files can only be written for a single file\n");
+			usage(EXIT_FAILURE);
+		}
+	}
+	if (settings.checkpoint && settings.n_sinks > 1) {
+		fprintf(stderr, "! --checkpoint can only be used with a single output\n");
+		usage(EXIT_FAILURE);
+	}
+	if (settings.adaptive > 0 && (settings.checkpoint || (settings.first_last_only & B_FAST))) {
+		/* the reverse scan starts without knowing the noise-floor at the end */
+		fprintf(stderr, "! --adaptive can not be combined with --checkpoint or --fastbounds\n");
+		usage(EXIT_FAILURE);
+	}
+	if (settings.relative > 0 && (settings.adaptive > 0 || settings.checkpoint || settings.follow || (settings.first_last_only & B_FAST))) {
+		/* events are only known once the complete file was analyzed */
+		fprintf(stderr, "! --relative can not be combined with --adaptive, --checkpoint, --follow or --fastbounds\n");
+		usage(EXIT_FAILURE);
+	}
+	for (k = i; k < argc; ++k) {
+		if (strcmp(argv[k], "-")) continue;
+		if (settings.checkpoint || settings.follow || settings.all_streams || (settings.first_last_only & B_FAST)
+				|| settings.trim_output || settings.split) {
+			/* these need to seek or re-open the file */
+			fprintf(stderr, "! reading from stdin ('-') can not be combined with --checkpoint, --follow, --all-streams, --fastbounds, --trim-output or --split\n");
+			usage(EXIT_FAILURE);
+		}
+	}
+	if (settings.resume && !settings.checkpoint) {
+		fprintf(stderr, "! --resume requires a --checkpoint file\n");
+		usage(EXIT_FAILURE);
+	}
+
+	/* open output files - if any */
+	for (k = 0; k < settings.n_sinks; ++k) {
+		struct silan_sink *out = &settings.sinks[k];
+		if (!out->outfilename) {
+			out->outfile = stdout;
+			continue;
+		}
+		/* when resuming, previous output is truncated to the checkpoint */
+		out->outfile = fopen(out->outfilename, settings.resume ? "a" : "w");
+		if (!out->outfile) {
 			if (debug_level >= 0)
-				fprintf(stderr, "! cannot open output file '%s'.\n", settings.outfilename);
+				fprintf(stderr, "! cannot open output file '%s'.\n", out->outfilename);
 			rv=1;
 			goto cleanup;
 		}
-	} else {
-		settings.outfile = stdout;
 	}
 
 	/* initialize audio decoders */
 	ad_init();
 
-	/* all systems go */
-	rv = doit(&settings);
+	/* all systems go. Buffers and decoder state of a file are returned
+	 * to the pool, the next file of the same format re-uses them */
+	for (; i < argc; ++i) {
+		settings.fn = argv[i];
+		if (settings.all_streams)
+			rv |= doit_streams(&settings);
+		else
+			rv |= doit(&settings);
+	}
+	ad_exit();
 
 cleanup:
 	/* clean up*/
-	if (settings.fn) free(settings.fn);
-	if (settings.outfilename && settings.outfile) {
-		free(settings.outfilename);
-		fclose(settings.outfile);
+	free(settings.checkpoint);
+	free(settings.envelope);
+	free(settings.trim_output);
+	free(settings.split);
+	for (k = 0; k < settings.n_sinks; ++k) {
+		if (settings.sinks[k].outfilename && settings.sinks[k].outfile) {
+			fclose(settings.sinks[k].outfile);
+		}
+		free(settings.sinks[k].outfilename);
+		template_free(settings.sinks[k].tpl);
 	}
+	free(settings.sinks);
 
 	return rv;
 }
@@ -0,0 +1,84 @@
+/* silan - silence analyzer
+ *
+ * Copyright (C) 2012-2018 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "silan.h"
+
+/* sliding-window minimum of block energies.
+ *
+ * The deque holds the blocks that can still become the minimum:
+ * energies increase from head to tail, the head is the minimum of the
+ * window. A new block removes all larger ones from the tail, the head
+ * is removed once it leaves the window. Every block is added and
+ * removed once, O(1) amortized per block.
+ */
+
+struct noise_floor {
+	double  *energy;   // deque, increasing
+	int64_t *block;    // index of the block the energy was measured in
+	unsigned int size; // blocks per window
+	unsigned int head;
+	unsigned int len;
+	int64_t cnt;       // blocks processed
+};
+
+void *noise_floor_open(const unsigned int n_blocks) {
+	struct noise_floor *nf;
+	if (n_blocks < 1) return NULL;
+
+	nf = (struct noise_floor*) calloc(1, sizeof(struct noise_floor));
+	if (!nf) return NULL;
+
+	nf->size = n_blocks;
+	nf->energy = (double*) malloc(n_blocks * sizeof(double));
+	nf->block = (int64_t*) malloc(n_blocks * sizeof(int64_t));
+	if (!nf->energy || !nf->block) {
+		noise_floor_close(nf);
+		return NULL;
+	}
+	return nf;
+}
+
+double noise_floor_process(void *h, const double energy) {
+	struct noise_floor *nf = (struct noise_floor*) h;
+	const int64_t idx = nf->cnt++;
+
+	if (nf->len > 0 && nf->block[nf->head] <= idx - nf->size) {
+		nf->head = (nf->head + 1) % nf->size;
+		--nf->len;
+	}
+	while (nf->len > 0 && nf->energy[(nf->head + nf->len - 1) % nf->size] >= energy) {
+		--nf->len;
+	}
+	const unsigned int tail = (nf->head + nf->len) % nf->size;
+	nf->energy[tail] = energy;
+	nf->block[tail] = idx;
+	++nf->len;
+
+	return nf->cnt >= nf->size ? nf->energy[nf->head] : -1;
+}
+
+void noise_floor_close(void *h) {
+	struct noise_floor *nf = (struct noise_floor*) h;
+	if (!nf) return;
+	free(nf->energy);
+	free(nf->block);
+	free(nf);
+}
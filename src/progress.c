@@ -0,0 +1,125 @@
+/* silan - silence analyzer
+ *
+ * Copyright (C) 2012-2018 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "config.h"
+#include "silan.h"
+
+/* minimum wall-clock time between reports [ms] */
+#ifndef PROGRESS_INTERVAL_MS
+#define PROGRESS_INTERVAL_MS (250)
+#endif
+
+struct progress {
+	int tty;          // human readable percentage on stderr
+	int fd;           // JSON lines, -1: none
+	double t_start;   // wall-clock time of first report
+	double t_last;
+	int64_t f_start;  // position at start, when resuming
+	int64_t done;
+	int64_t total;
+};
+
+static double now(void) {
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+	}
+#endif
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+void *progress_open(struct silan_settings const * const ss, const int64_t start) {
+	if (!ss->progress && ss->progress_fd < 0) {
+		return NULL;
+	}
+	struct progress *p = (struct progress*) calloc(1, sizeof(struct progress));
+	if (!p) return NULL;
+	p->tty = ss->progress;
+	p->fd = ss->progress_fd;
+	p->t_start = p->t_last = now();
+	p->f_start = p->done = start;
+	return p;
+}
+
+static void progress_print(struct progress *p, const double t, const int final) {
+	const double elapsed = t - p->t_start;
+	const double fps = elapsed > 0 ? (p->done - p->f_start) / elapsed : 0;
+
+	if (p->tty) {
+		if (final) {
+			fprintf(stderr, "        \n");
+		} else if (p->total > 0) {
+			fprintf(stderr, " %3.1f%%     \r", p->done * 100.0 / p->total);
+		} else {
+			fprintf(stderr, " %"PRIi64"     \r", p->done);
+		}
+		fflush(stderr);
+	}
+
+	if (p->fd >= 0) {
+		char buf[256];
+		int len = snprintf(buf, sizeof(buf),
+				"{\"frames\":%"PRIi64", \"total\":%"PRIi64", \"fps\":%.0f, \"eta\":",
+				p->done, p->total, fps);
+		if (final) {
+			len += snprintf(buf + len, sizeof(buf) - len, "0, \"done\":true}\n");
+		} else if (fps > 0 && p->total >= p->done) {
+			len += snprintf(buf + len, sizeof(buf) - len, "%.1f}\n", (p->total - p->done) / fps);
+		} else {
+			/* unknown length (follow mode) or no progress yet */
+			len += snprintf(buf + len, sizeof(buf) - len, "null}\n");
+		}
+		/* a single write per line, readers see complete lines */
+		if (write(p->fd, buf, len) != len) {
+			p->fd = -1;
+		}
+	}
+	p->t_last = t;
+}
+
+void progress_update(void *h, const int64_t done, const int64_t total) {
+	struct progress *p = (struct progress*) h;
+	if (!p) return;
+	p->done = done;
+	p->total = total;
+	const double t = now();
+	if ((t - p->t_last) * 1000 >= PROGRESS_INTERVAL_MS) {
+		progress_print(p, t, 0);
+	}
+}
+
+void progress_close(void *h, const int completed) {
+	struct progress *p = (struct progress*) h;
+	if (!p) return;
+	if (completed) {
+		progress_print(p, now(), 1);
+	} else if (p->tty) {
+		fprintf(stderr, "\n");
+	}
+	free(p);
+}
@@ -0,0 +1,284 @@
+/* silan - silence analyzer
+ *
+ * Copyright (C) 2012-2018 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __SILAN_H__
+#define __SILAN_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ad.h"
+
+#define PERIODSIZE (1024)
+
+#define UNUSED(x) (void)(x)
+
+extern int debug_level;
+
+enum {
+	B_EN = 1,  ///< enable first/last mode
+	B_FAST = 2,///< enable 'fast' mode (process backwards after finding sound-on)
+	B_F1 = 4,  ///< found first sound-on
+	B_REV = 8, ///< reading/procssing backwards
+	B_F2 = 16, ///< found last sound-off
+};
+
+enum {
+	A_CLIP = 1, ///< clipping runs
+	A_DC = 2,   ///< DC offset
+	A_PEAK = 4, ///< sample-peak and true-peak
+};
+
+enum {PF_TXT = 0, PF_CSV, PF_JSON, PF_AUDACITY, PF_TEMPLATE};
+
+/** an output, every event is written to all outputs */
+struct silan_sink {
+	int printformat;
+	void *tpl;         // compiled --format-template, PF_TEMPLATE only
+	char *outfilename; // NULL: stdout
+	FILE *outfile;
+};
+
+struct silan_settings {
+	char *fn;
+	float threshold;
+	enum {PM_SAMPLES, PM_SECONDS, PM_BYTES} printmode;
+	float hpf_tc;
+	float holdoff_sec;
+	int progress;     // percentage on stderr
+	int progress_fd;  // JSON lines progress report, -1: none
+	struct silan_sink *sinks;
+	int n_sinks;
+	int first_last_only;
+	int include_initial;
+	char *checkpoint; // sidecar file for periodic state dumps
+	int resume;       // continue from checkpoint, if any
+	int follow;       // wait for data to be appended at EOF
+	int all_streams;  // analyze all audio streams of the container
+	char *envelope;   // peak/RMS overview side output
+	int envelope_block; // frames per envelope value
+	int analyze;      // additional analyzers, bitmask of A_*
+	int n_files;      // number of files given, > 1: output is tagged with the file-name
+	char *trim_output; // write audio between first and last sound to this file
+	char *split;      // file-name pattern, write every sound range to its own file
+	float adaptive;   // threshold relative to the noise-floor (factor), 0: fixed threshold
+	float noise_window; // seconds, the noise-floor is the quietest block in this time
+	float relative;   // threshold relative to the level of the file (factor), 0: absolute
+	int relative_peak; // --relative reference: 0: loudness, 1: peak
+};
+
+/** formatter state of an output */
+struct silan_format {
+	int64_t prev_on; // frame-number of latest 'On' state - used for delayed print -- JSON, audacity
+	int64_t prev_on_offset; // byte-offset of prev_on, -1: unknown
+	int cnt;         // number of ranges printed -- JSON
+};
+
+struct silan_state {
+	float *hpf_x; // HPF buffer (per channel)
+	float *hpf_y; // HPF buffer (per channel)
+
+	double rms_sum;
+	float  *window;     // squared HPF output, interleaved (stores the float product y0 * y0, as before)
+	float  *window_cur;
+	float  *window_end;
+	int     window_size;
+	double  t2;         // threshold of rms_sum
+	void   *noise;      // noise-floor tracker, NULL: fixed threshold
+	int     noise_pos;  // frames until the end of the current block
+	void   *levels;     // recorded RMS levels, see --relative, NULL: detect as we go
+	int     level_pos;  // frames until the next level is added
+
+	int state; // 0: silent, 1:non-silent
+	int64_t holdoff; // holdoff frame counter
+	int64_t prev_off; // frame-number of latest 'Off' state - used for delayed print
+	int first_last; // print only first & last
+	struct silan_format *fmt; // per output, see silan_settings.sinks
+	int64_t initial_silence_countdown;
+	int stream; // container stream-index to tag events with, -1: none
+	void *sf;   // decoder handle, for exact byte-offsets (PM_BYTES), NULL: estimate
+	int offset_estimated; // a byte-offset was not known to the decoder, warned once
+	int64_t first_on; // frame-number of the first 'On', -1: none
+	int64_t last_off; // frame-number of the last 'Off', -1: none
+	int64_t seg_on;   // start of the current sound range, -1: none -- split only
+	int64_t *segments; // start, end pairs of sound ranges -- split only
+	int n_segments;
+	int segments_alloc;
+};
+
+/* checkpoint.c */
+
+/** save analysis state to the sidecar file given by \ref silan_settings.checkpoint
+ * the file is replaced atomically. Checkpoints support a single output.
+ * @param frame_cnt number of frames that have been processed
+ * @return 0 on success, -1 on error
+ */
+int checkpoint_save (struct silan_settings const * const ss, struct adinfo const * const nfo,
+		struct silan_state const * const st, const int64_t frame_cnt);
+
+/** restore analysis state from the sidecar file.
+ * the file must have been written for the same input file and settings.
+ * st must be allocated for nfo->channels.
+ * @param frame_cnt set to the number of frames that have already been processed
+ * @param out_offset set to the output file-position at the time of the checkpoint
+ * @return 0 on success, 1 if there is no checkpoint, -1 on error
+ */
+int checkpoint_load (struct silan_settings const * const ss, struct adinfo const * const nfo,
+		struct silan_state * const st, int64_t *frame_cnt, int64_t *out_offset);
+
+/** remove the sidecar file after a successful run */
+void checkpoint_remove (struct silan_settings const * const ss);
+
+/* follow.c */
+
+/** start watching a file for appended data.
+ * this also installs SIGINT/SIGTERM handlers to end following gracefully.
+ * @return handle to pass to \ref follow_wait
+ */
+void *follow_open (const char *fn);
+
+/** block until the file has been modified.
+ * @return 0 if the file changed, 1 if the writer closed or removed the
+ * file or following was interrupted.
+ */
+int follow_wait (void *fw);
+
+void follow_close (void *fw);
+
+/* envelope.c */
+
+/** open the peak/RMS envelope output given by \ref silan_settings.envelope
+ * The format is JSON if the file-name ends in .json, binary otherwise.
+ * @return handle, NULL if no envelope is requested or on error
+ */
+void *envelope_open (struct silan_settings const * const ss, struct adinfo const * const nfo);
+
+/** accumulate interleaved audio data, the same data that is analyzed */
+void envelope_process (void *env, float const * const buf, const unsigned int n_frames);
+
+/** write the last (partial) block and close the file */
+void envelope_close (void *env);
+
+/* analyze.c */
+
+/** set up the pipeline of analyzers that process the same audio data as
+ * the silence detection: --envelope and --analyze
+ * @return handle, NULL if nothing is requested or on error
+ */
+void *analyze_open (struct silan_settings const * const ss, struct adinfo const * const nfo);
+
+/** pass interleaved audio data to all analyzers */
+void analyze_process (void *a, float const * const buf, const unsigned int n_frames);
+
+/** print the results of the --analyze stages
+ * @param json 1: JSON properties to be added to an object, 0: lines of text
+ */
+void analyze_report (void *a, FILE *f, const int json);
+
+/** end analysis, this also completes the envelope file */
+void analyze_close (void *a);
+
+/* noisefloor.c */
+
+/** track the minimum energy of the most recent n_blocks blocks
+ * @return handle, NULL on error
+ */
+void *noise_floor_open (const unsigned int n_blocks);
+
+/** add the energy of the next block
+ * @return minimum energy of the last n_blocks, -1 until n_blocks were processed
+ */
+double noise_floor_process (void *nf, const double energy);
+
+void noise_floor_close (void *nf);
+
+/* levels.c */
+
+/** start recording RMS window energies, see \ref silan_settings.relative
+ * memory is bounded, see levels.c
+ * @param gate absolute gate, values below are not part of the mean
+ * @return handle, NULL on error
+ */
+void *levels_open (const double gate);
+
+/** append a value */
+void levels_add (void *lv, const float energy);
+
+/** recorded envelope, call once after the last \ref levels_add
+ * @param n set to the number of values
+ * @param span set to the number of added values per returned value
+ * @return array of values, the mean energy of each span
+ */
+float const *levels_data (void *lv, int64_t *n, int *span);
+
+/** reference level of the values added so far
+ * @param peak 1: maximum, 0: gated mean (loudness), see levels.c for its accuracy
+ */
+double levels_reference (void *lv, const int peak);
+
+void levels_close (void *lv);
+
+/* template.c */
+
+/** a sound range, as printed by a --format-template */
+struct silan_range {
+	const char *fn;
+	int stream;         // -1: none
+	int index;          // number of the range, starting at 1
+	int64_t start;      // frame-number
+	int64_t end;        // frame-number
+	int64_t start_byte;
+	int64_t end_byte;
+	int sample_rate;
+};
+
+/** parse a --format-template
+ * @return handle, NULL if the template is invalid (an error is printed)
+ */
+void *template_compile (const char *tpl);
+
+/** print a sound range according to the template */
+void template_emit (void *tpl, FILE *f, struct silan_range const * const r);
+
+/** fingerprint of a compiled template, see checkpoint_save()
+ * @return 0 if tpl is NULL */
+uint32_t template_hash (void *tpl);
+
+void template_free (void *tpl);
+
+/* progress.c */
+
+/** start progress reporting, as requested by \ref silan_settings.progress
+ * and \ref silan_settings.progress_fd
+ * @param start number of frames already processed (when resuming)
+ * @return handle, NULL if progress is not reported
+ */
+void *progress_open (struct silan_settings const * const ss, const int64_t start);
+
+/** update progress. Reports are rate-limited by wall-clock time,
+ * so this can be called for every processed period.
+ * @param done number of frames processed so far
+ * @param total total number of frames, may grow (follow mode)
+ */
+void progress_update (void *p, const int64_t done, const int64_t total);
+
+/** end progress reporting
+ * @param completed print a final report, the analysis is complete
+ */
+void progress_close (void *p, const int completed);
+
+#endif
@@ -0,0 +1,196 @@
+/* silan - silence analyzer
+ *
+ * Copyright (C) 2012-2018 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "config.h"
+#include "silan.h"
+
+/* --format-template, compiled to a list of operations */
+
+enum tpl_op_type {
+	OP_LITERAL,
+	OP_START_SEC,
+	OP_END_SEC,
+	OP_DURATION_SEC,
+	OP_START_SAMPLES,
+	OP_END_SAMPLES,
+	OP_DURATION_SAMPLES,
+	OP_START_BYTES,
+	OP_END_BYTES,
+	OP_FILE,
+	OP_INDEX,
+	OP_STREAM,
+};
+
+struct tpl_op {
+	enum tpl_op_type type;
+	size_t off; // OP_LITERAL: position in text
+	size_t len; // OP_LITERAL: length
+};
+
+struct tpl {
+	char *text; // literals, escapes resolved
+	struct tpl_op *ops;
+	int n_ops;
+};
+
+static void add_op(struct tpl *t, enum tpl_op_type type, size_t off, size_t len) {
+	/* merge adjacent literals */
+	if (type == OP_LITERAL && t->n_ops > 0 && t->ops[t->n_ops - 1].type == OP_LITERAL) {
+		t->ops[t->n_ops - 1].len += len;
+		return;
+	}
+	t->ops[t->n_ops].type = type;
+	t->ops[t->n_ops].off = off;
+	t->ops[t->n_ops].len = len;
+	++t->n_ops;
+}
+
+void *template_compile(const char *tpl) {
+	const size_t len = strlen(tpl);
+	struct tpl *t;
+	size_t o = 0;
+	const char *p;
+
+	t = (struct tpl*) calloc(1, sizeof(struct tpl));
+	if (!t) return NULL;
+	/* every character is at most one op */
+	t->text = (char*) malloc(len + 1);
+	t->ops = (struct tpl_op*) malloc((len + 1) * sizeof(struct tpl_op));
+	if (!t->text || !t->ops) {
+		template_free(t);
+		return NULL;
+	}
+
+	for (p = tpl; *p; ++p) {
+		if (*p == '\\' && p[1]) {
+			++p;
+			switch (*p) {
+				case 'n': t->text[o] = '\n'; break;
+				case 't': t->text[o] = '\t'; break;
+				case '\\': t->text[o] = '\\'; break;
+				default:
+					fprintf(stderr, "! invalid escape sequence '\\%c' in format template.\n", *p);
+					template_free(t);
+					return NULL;
+			}
+			add_op(t, OP_LITERAL, o++, 1);
+			continue;
+		}
+		if (*p != '%') {
+			t->text[o] = *p;
+			add_op(t, OP_LITERAL, o++, 1);
+			continue;
+		}
+		switch (*++p) {
+			case '%': t->text[o] = '%'; add_op(t, OP_LITERAL, o++, 1); break;
+			case 's': add_op(t, OP_START_SEC, 0, 0); break;
+			case 'e': add_op(t, OP_END_SEC, 0, 0); break;
+			case 'd': add_op(t, OP_DURATION_SEC, 0, 0); break;
+			case 'S': add_op(t, OP_START_SAMPLES, 0, 0); break;
+			case 'E': add_op(t, OP_END_SAMPLES, 0, 0); break;
+			case 'D': add_op(t, OP_DURATION_SAMPLES, 0, 0); break;
+			case 'b': add_op(t, OP_START_BYTES, 0, 0); break;
+			case 'B': add_op(t, OP_END_BYTES, 0, 0); break;
+			case 'f': add_op(t, OP_FILE, 0, 0); break;
+			case 'n': add_op(t, OP_INDEX, 0, 0); break;
+			case 'c': add_op(t, OP_STREAM, 0, 0); break;
+			default:
+				if (*p) {
+					fprintf(stderr, "! invalid conversion '%%%c' in format template.\n", *p);
+				} else {
+					fprintf(stderr, "! format template ends with '%%'.\n");
+				}
+				template_free(t);
+				return NULL;
+		}
+	}
+	return t;
+}
+
+void template_emit(void *h, FILE *f, struct silan_range const * const r) {
+	struct tpl const *t = (struct tpl const*) h;
+	int i;
+	for (i = 0; i < t->n_ops; ++i) {
+		struct tpl_op const *op = &t->ops[i];
+		switch (op->type) {
+			case OP_LITERAL:
+				fwrite(t->text + op->off, 1, op->len, f);
+				break;
+			case OP_START_SEC:
+				fprintf(f, "%f", (double) r->start / r->sample_rate);
+				break;
+			case OP_END_SEC:
+				fprintf(f, "%f", (double) r->end / r->sample_rate);
+				break;
+			case OP_DURATION_SEC:
+				fprintf(f, "%f", (double) (r->end - r->start) / r->sample_rate);
+				break;
+			case OP_START_SAMPLES:
+				fprintf(f, "%"PRIi64, r->start);
+				break;
+			case OP_END_SAMPLES:
+				fprintf(f, "%"PRIi64, r->end);
+				break;
+			case OP_DURATION_SAMPLES:
+				fprintf(f, "%"PRIi64, r->end - r->start);
+				break;
+			case OP_START_BYTES:
+				fprintf(f, "%"PRIi64, r->start_byte);
+				break;
+			case OP_END_BYTES:
+				fprintf(f, "%"PRIi64, r->end_byte);
+				break;
+			case OP_FILE:
+				fputs(r->fn, f);
+				break;
+			case OP_INDEX:
+				fprintf(f, "%d", r->index);
+				break;
+			case OP_STREAM:
+				if (r->stream >= 0) fprintf(f, "%d", r->stream);
+				break;
+		}
+	}
+}
+
+uint32_t template_hash(void *h) {
+	struct tpl const *t = (struct tpl const*) h;
+	uint32_t hash = 2166136261u; // FNV-1a
+	int i;
+	size_t k;
+	if (!t) return 0;
+	for (i = 0; i < t->n_ops; ++i) {
+		hash = (hash ^ (uint32_t) t->ops[i].type) * 16777619u;
+		for (k = 0; t->ops[i].type == OP_LITERAL && k < t->ops[i].len; ++k) {
+			hash = (hash ^ (unsigned char) t->text[t->ops[i].off + k]) * 16777619u;
+		}
+	}
+	return hash;
+}
+
+void template_free(void *h) {
+	struct tpl *t = (struct tpl*) h;
+	if (!t) return;
+	free(t->text);
+	free(t->ops);
+	free(t);
+}
@@ -0,0 +1,48 @@
+#!/bin/bash
+## check reading audio from a pipe (stdin, file-name '-'):
+## the format is probed from the data, libsndfile first, then ffmpeg.
+## The results are compared with those of reading the file.
+##
+## usage: ./x-pipecheck.sh [silan-binary] <audio-file> [<audio-file> ...]
+##
+## Use files that libsndfile can not read (e.g. mp3, m4a) to check that
+## ffmpeg is tried after libsndfile has probed the start of the pipe.
+
+: ${SILAN=src/silan}
+if test -x "$1" -a ! -d "$1"; then
+	SILAN=$1
+	shift
+fi
+
+if test $# -lt 1 -o ! -x "$SILAN"; then
+	echo "usage: $0 [silan-binary] <audio-file> [<audio-file> ...]" >&2
+	exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+RV=0
+
+for FILE in "$@"; do
+	if test ! -f "$FILE"; then
+		echo "FAIL [$FILE] no such file"
+		RV=1
+		continue
+	fi
+	for OPTS in "" "-b" "-f json -u samples"; do
+		"$SILAN" -q $OPTS "$FILE" > "$TMP/file.out"
+		cat "$FILE" | "$SILAN" -q $OPTS - > "$TMP/pipe.out"
+		if test ! -s "$TMP/pipe.out"; then
+			echo "FAIL [$OPTS] $FILE: no output from the pipe"
+			RV=1
+		elif cmp -s "$TMP/file.out" "$TMP/pipe.out"; then
+			echo "ok   [$OPTS] $FILE"
+		else
+			echo "FAIL [$OPTS] $FILE: results differ"
+			diff "$TMP/file.out" "$TMP/pipe.out" | head
+			RV=1
+		fi
+	done
+done
+
+exit $RV
@@ -0,0 +1,111 @@
+#!/bin/bash
+## check reading remote files through the block cache (ffmpeg backend):
+## serve an audio file from a local HTTP server that supports range
+## requests, and compare the results with those of the local file.
+## Besides the initial probe, every request must be for a bounded range.
+##
+## usage: ./x-rangecheck.sh <audio-file> [silan-binary]
+##
+## The cache size can be set with AD_CACHE_MB=<MiB> in the environment.
+## requires python3
+
+FILE=$1
+: ${SILAN=${2:-src/silan}}
+: ${PORT=8765}
+
+if test ! -f "$FILE" -o ! -x "$SILAN"; then
+	echo "usage: $0 <audio-file> [silan-binary]" >&2
+	exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'kill $SERVER 2>/dev/null; rm -rf "$TMP"' EXIT
+# keep the extension, it selects the decoder
+NAME=audio.${FILE##*.}
+cp "$FILE" "$TMP/$NAME"
+SIZE=$(stat -c %s "$TMP/$NAME")
+
+# single-range server, logs the bytes sent per request and whether
+# the requested range was bounded
+cat > "$TMP/serve.py" << 'EOF'
+import http.server, os, re, sys
+
+class H(http.server.BaseHTTPRequestHandler):
+	def do_HEAD(self):
+		self.reply(False)
+	def do_GET(self):
+		self.reply(True)
+	def reply(self, body):
+		fn = os.path.join(sys.argv[2], self.path.lstrip('/'))
+		if not os.path.isfile(fn):
+			self.send_error(404)
+			return
+		size = os.path.getsize(fn)
+		start, end = 0, size - 1
+		bounded = 0
+		m = re.match(r'bytes=(\d+)-(\d*)$', self.headers.get('Range', ''))
+		if m:
+			start = int(m.group(1))
+			end = min(int(m.group(2)), end) if m.group(2) else end
+			bounded = 1 if m.group(2) else 0
+			if start >= size:
+				self.send_response(416)
+				self.send_header('Content-Range', 'bytes */%d' % size)
+				self.end_headers()
+				return
+			self.send_response(206)
+			self.send_header('Content-Range', 'bytes %d-%d/%d' % (start, end, size))
+		else:
+			self.send_response(200)
+		self.send_header('Accept-Ranges', 'bytes')
+		self.send_header('Content-Length', str(end - start + 1))
+		self.end_headers()
+		if not body:
+			return
+		sent = 0
+		with open(fn, 'rb') as f:
+			f.seek(start)
+			while sent < end - start + 1:
+				buf = f.read(min(65536, end - start + 1 - sent))
+				if not buf:
+					break
+				try:
+					self.wfile.write(buf)
+				except (BrokenPipeError, ConnectionResetError):
+					break
+				sent += len(buf)
+		with open(os.path.join(sys.argv[2], 'log'), 'a') as log:
+			log.write('%d %d\n' % (sent, bounded))
+	def log_message(self, *args):
+		pass
+
+http.server.ThreadingHTTPServer(('127.0.0.1', int(sys.argv[1])), H).serve_forever()
+EOF
+
+python3 "$TMP/serve.py" $PORT "$TMP" &
+SERVER=$!
+sleep 1
+
+URL=http://127.0.0.1:$PORT/$NAME
+RV=0
+
+for OPTS in "" "-b" "-B" "-f json -u samples"; do
+	rm -f "$TMP/log"
+	"$SILAN" -q $OPTS "$TMP/$NAME" > "$TMP/local.out"
+	"$SILAN" -q $OPTS "$URL" > "$TMP/remote.out"
+	SENT=$(awk '{ s += $1 } END { print s + 0 }' "$TMP/log" 2>/dev/null)
+	REQS=$(wc -l < "$TMP/log" 2>/dev/null)
+	OPEN=$(awk '$2 == 0 { n++ } END { print n + 0 }' "$TMP/log" 2>/dev/null)
+	if ! cmp -s "$TMP/local.out" "$TMP/remote.out"; then
+		echo "FAIL [$OPTS] results differ"
+		diff "$TMP/local.out" "$TMP/remote.out" | head
+		RV=1
+	elif test "$OPEN" -gt 1; then
+		echo "FAIL [$OPTS] $OPEN of $REQS requests were open-ended"
+		RV=1
+	else
+		echo "ok   [$OPTS] $REQS requests, $SENT of $SIZE bytes"
+	fi
+done
+
+exit $RV
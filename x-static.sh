@@ -59,6 +59,8 @@ LIBAD_SRC=" \
   audio_decoder/ad_soundfile.c \
   audio_decoder/ad_plugin.c \
   audio_decoder/ad_ffmpeg.c \
+  audio_decoder/ad_io.c \
+  audio_decoder/ad_pool.c \
  "
 
 # compile silan